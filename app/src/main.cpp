@@ -1,6 +1,19 @@
+#include "objects/AppOptions.h"
+#include "objects/EglContext.h"
 #include "objects/FluidSim.h"
+#include "objects/FrameCapture.h"
+#include "objects/HeapCounter.h"
+#include "objects/ImageSequence.h"
+#include "objects/JobSystem.h"
 #include "objects/MainWindow.h"
+#include "objects/RenderBench.h"
+#include "objects/TrajectoryPlayer.h"
+#include "objects/TrajectoryRecorder.h"
 #include <GLFW/glfw3.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
 #include <glad/glad.h>
 #include <iostream>
 
@@ -60,21 +73,42 @@ static GLuint CreateParticleProgram() {
       "layout(location=0) in vec2 aVertex;\n"
       "layout(location=1) in vec3 aInstance;\n"
       "uniform float uRadius;\n"
+      "uniform vec2  uPointScale;\n"
+      "uniform float uMaxSpeed;\n"
       "out float vSpeed;\n"
+      "out vec2  vLocal;\n"
+      "out vec2  vPointStretch;\n"
       "void main(){\n"
-      "  vSpeed = aInstance.z;\n"
+      "  vSpeed = clamp(aInstance.z / uMaxSpeed, 0.0, 1.0);\n"
+      "  vLocal = aVertex;\n"
       "  gl_Position = vec4(aVertex * uRadius + aInstance.xy, 0.0, 1.0);\n"
+      "  // A point is square: cover the wider axis and trim the other in\n"
+      "  // the fragment shader, matching the fan and quad footprint.\n"
+      "  float side = max(uPointScale.x, uPointScale.y);\n"
+      "  gl_PointSize = uRadius * side;\n"
+      "  vPointStretch = side / uPointScale;\n"
       "}\n";
 
+  // uMode: 0 = triangle fan, 1 = quad, 2 = point sprite
   const char *fs = "#version 330 core\n"
                    "in  float vSpeed;\n"
+                   "in  vec2  vLocal;\n"
+                   "in  vec2  vPointStretch;\n"
                    "out vec4  FragColor;\n"
                    "uniform vec3 uColorLow;\n"
                    "uniform vec3 uColorHigh;\n"
+                   "uniform int  uMode;\n"
                    "void main(){\n"
                    "  vec3 col = mix(uColorLow, uColorHigh, vSpeed);\n"
-                   "  // soft circular edge\n"
-                   "  FragColor = vec4(col, 0.88);\n"
+                   "  // soft circular edge: circle SDF in radius units\n"
+                   "  vec2 p = vLocal;\n"
+                   "  if (uMode == 2)\n"
+                   "    p = (gl_PointCoord * 2.0 - 1.0) * vPointStretch;\n"
+                   "  float d = length(p) - 1.0;\n"
+                   "  float aa = max(fwidth(d), 1e-4);\n"
+                   "  float cover = clamp(0.5 - d / aa, 0.0, 1.0);\n"
+                   "  if (cover <= 0.0) discard;\n"
+                   "  FragColor = vec4(col, 0.88 * cover);\n"
                    "}\n";
 
   return LinkProgram(CompileShader(GL_VERTEX_SHADER, vs),
@@ -95,29 +129,405 @@ static GLuint CreateSceneProgram() {
                      CompileShader(GL_FRAGMENT_SHADER, fs));
 }
 
-int main() {
-  if (!glfwInit())
-    return -1;
+static void PrintMemoryTable(const FluidSim &fluid) {
+  auto mb = [](size_t b) { return b / (1024.0 * 1024.0); };
+  std::printf("%10s %10s %10s %10s %10s %10s %10s %10s\n", "capacity",
+              "particles", "instances", "grid", "boundary", "scratch", "gpu",
+              "total");
+  std::printf("%10s %10s %10s %10s %10s %10s %10s %10s\n", "", "MiB", "MiB",
+              "MiB", "MiB", "MiB", "MiB", "MiB");
+  for (int cap : {fluid.GetCapacity(), 1000, 10000, 100000, 1000000}) {
+    MemoryReport r = fluid.EstimateMemory(cap);
+    std::printf("%10d %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                cap, mb(r.particleBytes), mb(r.instanceBytes),
+                mb(r.gridBytes), mb(r.boundaryBytes), mb(r.scratchBytes),
+                mb(r.gpuBytes), mb(r.Total()));
+  }
+}
+
+// Hardware counters per solver phase, per particle and step.
+static void PrintPerfCounters(const PhaseCounters &c) {
+  std::printf("%-11s %10s %6s %11s %11s %11s\n", "phase", "cycles/p", "IPC",
+              "L1d miss/p", "LLC miss/p", "br miss/p");
+  auto row = [&](const char *name, const PerfSample &s) {
+    char cols[4][16];
+    const PerfEvent events[4] = {PerfEvent::Cycles, PerfEvent::L1dMisses,
+                                 PerfEvent::LlcMisses,
+                                 PerfEvent::BranchMisses};
+    for (int i = 0; i < 4; ++i) {
+      if (c.Has(events[i]))
+        std::snprintf(cols[i], sizeof(cols[i]), i ? "%.3f" : "%.1f",
+                      c.PerParticle(s, events[i]));
+      else
+        std::snprintf(cols[i], sizeof(cols[i]), "n/a");
+    }
+    char ipc[16] = "n/a";
+    if (c.Has(PerfEvent::Instructions))
+      std::snprintf(ipc, sizeof(ipc), "%.2f", PhaseCounters::Ipc(s));
+    std::printf("%-11s %10s %6s %11s %11s %11s\n", name, cols[0], ipc,
+                cols[1], cols[2], cols[3]);
+  };
+  for (int p = 0; p < SolverPhaseCount; ++p)
+    row(SolverPhaseName((SolverPhase)p), c.phases[p]);
+  row("total", c.Sum());
+}
 
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+// --scene and --render-mode: all that drawing a recorded trajectory needs.
+static void ConfigureView(FluidSim &fluid, const AppOptions &opts) {
+  fluid.SetRenderMode(opts.renderMode);
+  if (!opts.scenePath.empty()) {
+    Scene scene;
+    if (LoadSceneFile(opts.scenePath, scene))
+      fluid.LoadScene(scene);
+  }
+}
 
-  GLFWwindow *window =
-      glfwCreateWindow(1280, 720, "Fluid Simulation", nullptr, nullptr);
-  if (!window) {
-    glfwTerminate();
-    return -1;
+// Solver settings shared by the interactive and headless paths. Returns
+// false if a requested checkpoint could not be loaded.
+static bool ConfigureSim(FluidSim &fluid, const AppOptions &opts) {
+  fluid.SetCapacity(opts.capacity);
+  if (opts.isaOverride) {
+    if (opts.isa > DetectCpuIsa())
+      std::cerr << "--isa " << CpuIsaName(opts.isa)
+                << " is not supported by this CPU, using "
+                << CpuIsaName(DetectCpuIsa()) << "\n";
+    fluid.SetIsa(opts.isa);
   }
-  glfwMakeContextCurrent(window);
-  glfwSwapInterval(1);
+  fluid.SetBoundaryMode(opts.boundaryMode);
+  fluid.SetCollisionMode(opts.collisionMode);
+  fluid.SetKernel(opts.kernel);
+  fluid.SetPrecision(opts.precision);
+  fluid.SetBoundaryParticles(opts.boundaryParticles);
+  ConfigureView(fluid, opts);
+  if (!opts.checkpointPath.empty()) {
+    if (!fluid.LoadCheckpoint(opts.checkpointPath))
+      return false;
+  } else if (opts.initEnabled) {
+    fluid.GenerateInitial(opts.initShape, opts.initCount,
+                          (uint32_t)opts.initSeed, opts.relaxIterations);
+  }
+  if (opts.perf && !fluid.SetPerfCounters(true))
+    std::cerr << "--perf: " << fluid.GetPerfError()
+              << ", running without hardware counters\n";
+  else if (opts.perf && !fluid.GetPerfError().empty())
+    std::cerr << "--perf: " << fluid.GetPerfError() << "\n";
+  return true;
+}
+
+// The offscreen scene framebuffer and the programs that draw into it.
+struct SceneTarget {
+  GLuint fbo = 0;
+  int width = 0, height = 0;
+  GLuint sceneProg = 0;
+  GLint uColor = -1;
+  GLuint particleProg = 0;
+  ParticleUniforms particleU;
+};
+
+// Draws the scene into its framebuffer, with the solver's particles or,
+// while a trajectory plays, the player's frame uploaded to `playback`.
+static void DrawScene(const SceneTarget &t, FluidSim &fluid,
+                      const TrajectoryPlayer &player,
+                      ParticleRenderer *playback) {
+  glBindFramebuffer(GL_FRAMEBUFFER, t.fbo);
+  glViewport(0, 0, t.width, t.height);
+  glClearColor(0.13f, 0.15f, 0.19f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  fluid.RenderScene(t.sceneProg, t.uColor);
+  if (player.IsOpen() && playback) {
+    playback->SetMode(fluid.GetRenderMode());
+    playback->Draw(t.particleProg, t.particleU, fluid.GetRenderRadius(),
+                   fluid.GetBaseColor(), fluid.GetHighColor(),
+                   player.GetMaxSpeed(), (int)player.GetInstances().size());
+  } else {
+    fluid.RenderParticles(t.particleProg, t.particleU);
+  }
+}
+
+// Screenshot or capture file names, unique per session second.
+static std::string CapturePrefix(const char *kind) {
+  std::time_t now = std::time(nullptr);
+  char stamp[32];
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+  return std::string(kind) + "-" + stamp + "-";
+}
 
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-    std::cerr << "GLAD init failed\n";
-    glfwDestroyWindow(window);
-    glfwTerminate();
-    return -1;
+// Trajectory grid: the container plus a margin for particles that overshoot
+// a wall within a step.
+static bool StartRecording(TrajectoryRecorder &recorder,
+                           const FluidSim &fluid, const std::string &path) {
+  const Scene &scene = fluid.GetScene();
+  glm::vec2 pad = (scene.containerMax - scene.containerMin) * 0.05f;
+  return recorder.Open(path, scene.containerMin - pad,
+                       scene.containerMax + pad);
+}
+
+static void PrintTrajectoryStats(TrajectoryRecorder &recorder) {
+  TrajectoryStats r = recorder.GetStats();
+  std::printf("trajectory %s: %llu frames, %.2f MiB, %.1fx smaller than "
+              "raw, %llu stalls\n",
+              recorder.GetPath().c_str(), (unsigned long long)r.frames,
+              r.fileBytes / (1024.0 * 1024.0), r.Ratio(),
+              (unsigned long long)r.stalls);
+}
+
+// Decodes every frame of a trajectory in order, then seeks to frames in a
+// scattered order: the whole CPU cost of playback, without GL.
+static int RunPlaybackTiming(const AppOptions &opts) {
+  TrajectoryPlayer player;
+  if (!player.Open(opts.playPath))
+    return 1;
+  using Clock = std::chrono::steady_clock;
+  int frames = player.GetFrameCount();
+  auto t0 = Clock::now();
+  for (int f = 1; f < frames; ++f)
+    if (!player.SeekFrame(f))
+      return 1;
+  auto t1 = Clock::now();
+  int seeks = std::min(frames, 200);
+  for (int i = 0; i < seeks; ++i)
+    player.SeekFrame((int)((i * 2654435761u) % (unsigned)frames));
+  auto t2 = Clock::now();
+  auto ms = [](Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+  };
+  std::printf("%d frames of up to %d particles, %.2f s recorded\n", frames,
+              player.GetMaxParticles(),
+              player.GetEndTime() - player.GetStartTime());
+  std::printf("sequential: %.3f ms/frame\n",
+              ms(t1 - t0) / std::max(frames - 1, 1));
+  std::printf("random seek: %.3f ms/seek\n", ms(t2 - t1) / seeks);
+  return 0;
+}
+
+// Fixed 1/60 s frames without any GL. Every pass is deterministic, so the
+// checksums match across runs and thread counts.
+// The estimates are analytic: they need the solver settings, but no GL
+// context and no particles, so --init is skipped.
+static int RunMemoryTable(AppOptions opts) {
+  FluidSim fluid(false);
+  opts.initEnabled = false;
+  if (!ConfigureSim(fluid, opts))
+    return 1;
+  PrintMemoryTable(fluid);
+  return 0;
+}
+
+static int RunHeadless(const AppOptions &opts) {
+  FluidSim fluid(false);
+  if (!ConfigureSim(fluid, opts))
+    return 1;
+  FILE *allocCsv = nullptr;
+  if (!opts.allocCsvPath.empty()) {
+    if (!AllocHookInstalled())
+      std::cerr << "--alloc-csv: release build without FLUID_ALLOC_HOOK, "
+                   "no heap counts\n";
+    else if (!(allocCsv = std::fopen(opts.allocCsvPath.c_str(), "w")))
+      std::cerr << "Cannot write " << opts.allocCsvPath << "\n";
+    else
+      std::fprintf(allocCsv, "step,tag,allocs,frees,bytes\n");
+  }
+  TrajectoryRecorder recorder;
+  if (!opts.recordPath.empty() &&
+      !StartRecording(recorder, fluid, opts.recordPath))
+    return 1;
+  AllocStats lastAllocs = ReadAllocStats();
+  for (int step = 1; step <= opts.steps; ++step) {
+    {
+      AllocTagScope tag(AllocTag::Solver);
+      fluid.Update(1.0f / 60.0f);
+    }
+    if (recorder.IsOpen() && fluid.GetRunning())
+      recorder.Capture(fluid.GetInstances(), fluid.GetFrameTime());
+    if (opts.checksum)
+      std::printf("step %d particles %d checksum %016llx\n", step,
+                  fluid.GetParticleCount(),
+                  (unsigned long long)fluid.GetStateChecksum());
+    if (allocCsv) {
+      AllocStats now = ReadAllocStats();
+      AllocStats d = now - lastAllocs;
+      lastAllocs = now;
+      for (int t = 0; t < AllocTagCount; ++t)
+        std::fprintf(allocCsv, "%d,%s,%llu,%llu,%llu\n", step,
+                     AllocTagName((AllocTag)t),
+                     (unsigned long long)d.tags[t].allocs,
+                     (unsigned long long)d.tags[t].frees,
+                     (unsigned long long)d.tags[t].bytes);
+    }
+  }
+  if (allocCsv)
+    std::fclose(allocCsv);
+  std::printf("%d steps, %d particles, %d threads, %s path, "
+              "checksum %016llx\n",
+              opts.steps, fluid.GetParticleCount(),
+              JobSystem::Get().GetThreadCount(), CpuIsaName(fluid.GetIsa()),
+              (unsigned long long)fluid.GetStateChecksum());
+  if (fluid.GetPerfCounters())
+    PrintPerfCounters(fluid.GetPerfTotal());
+  if (recorder.IsOpen()) {
+    bool ok = recorder.Close();
+    PrintTrajectoryStats(recorder);
+    if (!ok)
+      return 1;
+  }
+  if (!opts.saveCheckpointPath.empty() &&
+      !fluid.SaveCheckpoint(opts.saveCheckpointPath))
+    return 1;
+  return 0;
+}
+
+// Renders --steps solver frames of 1/60 s, or every frame of --play, into
+// the scene framebuffer and captures each one to --y4m or --render-frames.
+// Readback and encoding run behind the drawing (FrameCapture).
+static int RenderOffline(const AppOptions &opts, const SceneTarget &target) {
+  FluidSim fluid;
+  TrajectoryPlayer player;
+  std::unique_ptr<ParticleRenderer> playback;
+  int frames = opts.steps;
+  int fps = 60;
+  if (opts.playPath.empty()) {
+    if (!ConfigureSim(fluid, opts))
+      return 1;
+  } else {
+    // Nothing is simulated: no checkpoint, initial fill or solver setup.
+    ConfigureView(fluid, opts);
+    if (!player.Open(opts.playPath))
+      return 1;
+    playback = std::make_unique<ParticleRenderer>(player.GetMaxParticles());
+    frames = player.GetFrameCount();
+    double span = player.GetEndTime() - player.GetStartTime();
+    if (frames > 1 && span > 0.0)
+      fps = std::max(1, (int)std::lround((frames - 1) / span));
+  }
+  FrameCapture capture;
+  bool video = !opts.videoPath.empty();
+  if (video ? !capture.StartVideo(opts.videoPath, target.width,
+                                  target.height, fps)
+            : !capture.Start(opts.framesDir, "frame_", opts.imageFormat,
+                             target.width, target.height))
+    return 1;
+
+  auto start = std::chrono::steady_clock::now();
+  bool decoded = true;
+  for (int frame = 0; frame < frames; ++frame) {
+    if (player.IsOpen()) {
+      // Open() decoded frame 0.
+      if (frame > 0 && !player.SeekFrame(frame)) {
+        decoded = false;
+        break;
+      }
+      std::span<const glm::vec3> inst = player.GetInstances();
+      playback->Upload(inst.data(), (int)inst.size());
+    } else {
+      fluid.Update(1.0f / 60.0f);
+    }
+    DrawScene(target, fluid, player, playback.get());
+    capture.Update();
+  }
+  bool ok = capture.Finish() && decoded;
+  FrameCaptureStats s = capture.GetStats();
+  capture.Shutdown();
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  // The video itself may be on stdout.
+  std::FILE *log = opts.videoPath == "-" ? stderr : stdout;
+  std::fprintf(log,
+               "%llu %s frames in %s, %.1f MiB, %.1f frames/s, %llu GPU "
+               "waits, %llu encoder stalls\n",
+               (unsigned long long)s.written,
+               video ? "y4m" : ImageFormatName(opts.imageFormat),
+               video ? opts.videoPath.c_str() : opts.framesDir.c_str(),
+               s.bytes / (1024.0 * 1024.0),
+               s.written / std::max(seconds, 1e-9),
+               (unsigned long long)s.gpuWaits,
+               (unsigned long long)s.encoderStalls);
+  return ok ? 0 : 1;
+}
+
+// No window with --context egl.
+static void DestroyWindow(GLFWwindow *window) {
+  if (!window)
+    return;
+  glfwDestroyWindow(window);
+  glfwTerminate();
+}
+
+// Owns what main() creates once the context is up and releases it on
+// every return path, the window (and with it the context) last.
+struct GlCleanup {
+  GLFWwindow *window = nullptr;
+  GLuint sceneFbo = 0, sceneTex = 0;
+  GLuint particleProg = 0, sceneProg = 0;
+
+  ~GlCleanup() {
+    glDeleteProgram(particleProg);
+    glDeleteProgram(sceneProg);
+    glDeleteFramebuffers(1, &sceneFbo);
+    glDeleteTextures(1, &sceneTex);
+    DestroyWindow(window);
+  }
+};
+
+int main(int argc, char **argv) {
+  AppOptions opts;
+  if (!ParseAppOptions(argc, argv, opts))
+    return 1;
+  if (opts.threads > 0)
+    JobSystem::Get().SetThreadCount(opts.threads);
+  if (opts.headless)
+    return opts.playPath.empty() ? RunHeadless(opts)
+                                 : RunPlaybackTiming(opts);
+  if (opts.memoryTable)
+    return RunMemoryTable(opts);
+
+  // Everything below the context renders into framebuffer objects; only
+  // the interactive mode needs a window.
+  bool offline = !opts.framesDir.empty() || !opts.videoPath.empty();
+  GLFWwindow *window = nullptr;
+  EglContext egl;
+  if (opts.context == GlBackend::Egl) {
+    if (!opts.benchRender && !offline) {
+      std::cerr << "--context egl has no window; use it with --bench-render, "
+                   "--render-frames or --y4m\n";
+      return -1;
+    }
+    if (!egl.Create(3, 3))
+      return -1;
+    if (!gladLoadGLLoader((GLADloadproc)EglContext::GetProcAddress)) {
+      std::cerr << "GLAD init failed\n";
+      return -1;
+    }
+    // stderr: stdout may carry --y4m video.
+    std::cerr << "EGL context: " << (const char *)glGetString(GL_RENDERER)
+              << ", OpenGL " << (const char *)glGetString(GL_VERSION) << "\n";
+  } else {
+    if (!glfwInit())
+      return -1;
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    if (opts.benchRender || offline)
+      glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    window =
+        glfwCreateWindow(1280, 720, "Fluid Simulation", nullptr, nullptr);
+    if (!window) {
+      glfwTerminate();
+      return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(1);
+
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+      std::cerr << "GLAD init failed\n";
+      DestroyWindow(window);
+      return -1;
+    }
   }
 
   const int sceneW = 800, sceneH = 600;
@@ -126,13 +536,33 @@ int main() {
 
   GLuint particleProg = CreateParticleProgram();
   GLuint sceneProg = CreateSceneProgram();
+  GlCleanup cleanup{window, sceneFbo, sceneTex, particleProg, sceneProg};
 
-  GLint uRadius = glGetUniformLocation(particleProg, "uRadius");
-  GLint uColorLow = glGetUniformLocation(particleProg, "uColorLow");
-  GLint uColorHigh = glGetUniformLocation(particleProg, "uColorHigh");
+  ParticleUniforms particleU;
+  particleU.radius = glGetUniformLocation(particleProg, "uRadius");
+  particleU.colorLow = glGetUniformLocation(particleProg, "uColorLow");
+  particleU.colorHigh = glGetUniformLocation(particleProg, "uColorHigh");
+  particleU.mode = glGetUniformLocation(particleProg, "uMode");
+  particleU.pointScale = glGetUniformLocation(particleProg, "uPointScale");
+  particleU.maxSpeed = glGetUniformLocation(particleProg, "uMaxSpeed");
   GLint uColor = glGetUniformLocation(sceneProg, "uColor");
+  SceneTarget target{sceneFbo, sceneW, sceneH, sceneProg, uColor,
+                     particleProg, particleU};
+
+  if (opts.benchRender) {
+    auto results =
+        RunRenderBenchmark(particleProg, particleU, sceneFbo, sceneW, sceneH,
+                           opts.benchParticles, opts.benchFrames, 0.022f);
+    PrintRenderBenchmark(results, opts.benchParticles);
+    return 0;
+  }
+
+  if (offline)
+    return RenderOffline(opts, target);
 
   FluidSim fluid;
+  // A checkpoint that fails to load leaves the default state running.
+  ConfigureSim(fluid, opts);
 
   MainWindow ui(window);
   ui.setRenderTexture(sceneTex, sceneW, sceneH);
@@ -142,51 +572,207 @@ int main() {
   ui.setOnReset([&]() { fluid.Reset(); });
   ui.setOnGravityChanged([&](float g) { fluid.SetGravity(g); });
   ui.setOnViscosityChanged([&](float v) { fluid.SetViscosity(v); });
+  ui.setOnStiffnessChanged([&](float k) { fluid.SetGasConstant(k); });
   ui.setOnQualityChanged([&](int q) { fluid.SetQuality(q); });
   ui.setOnRenderRadiusChanged([&](float r) { fluid.SetRenderRadius(r); });
   ui.setOnColorChanged(
       [&](float r, float g, float b) { fluid.SetBaseColor({r, g, b}); });
+  ui.setSceneInfo(fluid.GetScene().name, fluid.GetScene().GetSegmentCount(),
+                  fluid.GetEmitterCount());
+  ui.setSolverPath(CpuIsaName(fluid.GetIsa()), CpuIsaName(DetectCpuIsa()));
+  // Settings the solver owns; a checkpoint load replaces all of them.
+  auto syncSettings = [&](bool parameters) {
+    ui.setBoundaryMode((int)fluid.GetBoundaryMode());
+    ui.setCollisionMode((int)fluid.GetCollisionMode());
+    ui.setKernel((int)fluid.GetKernel());
+    ui.setPrecision((int)fluid.GetPrecision());
+    ui.setBoundaryParticles(fluid.GetBoundaryParticles());
+    ui.setSleeping(fluid.GetSleeping());
+    ui.setMultiRate(fluid.GetMultiRate());
+    ui.setCapacity(fluid.GetCapacity());
+    if (!parameters)
+      return;
+    ui.setRunning(fluid.GetRunning());
+    ui.setGravity(fluid.GetGravity());
+    ui.setViscosity(fluid.GetViscosity());
+    ui.setStiffness(fluid.GetGasConstant());
+    ui.setQuality(fluid.GetQuality());
+    ui.setRenderRadius(fluid.GetRenderRadius());
+    glm::vec3 c = fluid.GetBaseColor();
+    ui.setColor(c.x, c.y, c.z);
+    ui.setSceneInfo(fluid.GetScene().name,
+                    fluid.GetScene().GetSegmentCount(),
+                    fluid.GetEmitterCount());
+  };
+  syncSettings(!opts.checkpointPath.empty());
+  ui.setOnBoundaryModeChanged(
+      [&](int m) { fluid.SetBoundaryMode((BoundaryMode)m); });
+  ui.setOnCollisionModeChanged(
+      [&](int m) { fluid.SetCollisionMode((CollisionMode)m); });
+  ui.setOnKernelChanged([&](int k) { fluid.SetKernel((KernelFamily)k); });
+  ui.setOnPrecisionChanged([&](int p) { fluid.SetPrecision((Precision)p); });
+  ui.setOnBoundaryParticlesChanged(
+      [&](bool on) { fluid.SetBoundaryParticles(on); });
+  ui.setOnSleepingChanged([&](bool on) { fluid.SetSleeping(on); });
+  ui.setOnMultiRateChanged([&](bool on) { fluid.SetMultiRate(on); });
+  ui.setOnCapacityChanged([&](int cap) { fluid.SetCapacity(cap); });
+  if (!opts.checkpointPath.empty())
+    ui.setCheckpointPath(opts.checkpointPath);
+  ui.setOnSaveCheckpoint(
+      [&](const std::string &path) { fluid.SaveCheckpoint(path); });
+  ui.setOnLoadCheckpoint([&](const std::string &path) {
+    if (fluid.LoadCheckpoint(path))
+      syncSettings(true);
+  });
+  ui.setOnGenerate([&](int shape, int count) {
+    fluid.GenerateInitial((InitShape)shape, count, (uint32_t)opts.initSeed,
+                          opts.relaxIterations);
+    ui.setCapacity(fluid.GetCapacity());
+  });
+  ui.setOnPerfCountersChanged([&](bool on) { fluid.SetPerfCounters(on); });
+  TrajectoryRecorder recorder;
+  if (!opts.recordPath.empty()) {
+    ui.setRecordPath(opts.recordPath);
+    StartRecording(recorder, fluid, opts.recordPath);
+  }
+  ui.setOnRecordChanged([&](bool on, const std::string &path) {
+    if (on)
+      StartRecording(recorder, fluid, path);
+    else if (recorder.Close())
+      PrintTrajectoryStats(recorder);
+  });
+
+  // Playback replaces the solver: the simulation pauses where it is and
+  // frames go to a renderer of their own, so going live again shows the
+  // solver's instance buffer as it was.
+  TrajectoryPlayer player;
+  std::unique_ptr<ParticleRenderer> playbackRenderer;
+  auto showPlaybackFrame = [&]() {
+    std::span<const glm::vec3> inst = player.GetInstances();
+    playbackRenderer->Upload(inst.data(), (int)inst.size());
+  };
+  auto startPlayback = [&](const std::string &path) {
+    if (recorder.IsOpen() && recorder.Close())
+      PrintTrajectoryStats(recorder);
+    if (!player.Open(path))
+      return;
+    if (!playbackRenderer)
+      playbackRenderer =
+          std::make_unique<ParticleRenderer>(player.GetMaxParticles());
+    showPlaybackFrame();
+    player.SetPlaying(true);
+  };
+  if (!opts.playPath.empty()) {
+    ui.setRecordPath(opts.playPath);
+    startPlayback(opts.playPath);
+  }
+  ui.setOnPlaybackChanged([&](bool on, const std::string &path) {
+    if (on)
+      startPlayback(path);
+    else
+      player.Close();
+  });
+  ui.setOnPlaybackPlayingChanged([&](bool on) { player.SetPlaying(on); });
+  ui.setOnPlaybackSpeedChanged([&](float s) { player.SetSpeed(s); });
+  ui.setOnPlaybackLoopChanged([&](bool on) { player.SetLoop(on); });
+  ui.setOnPlaybackSeek([&](double t) {
+    if (player.SeekTime(t))
+      showPlaybackFrame();
+  });
+  ui.setOnPlaybackStep([&](int step) {
+    player.SetPlaying(false);
+    if (player.SeekFrame(player.GetFrame() + step))
+      showPlaybackFrame();
+  });
+  FrameCapture capture;
+  ui.setOnScreenshot([&](const std::string &dir) {
+    capture.Start(dir, CapturePrefix("screenshot"), opts.imageFormat, sceneW,
+                  sceneH, 1);
+  });
+  ui.setOnCaptureChanged([&](bool on, const std::string &dir) {
+    if (on)
+      capture.Start(dir, CapturePrefix("capture"), opts.imageFormat, sceneW,
+                    sceneH);
+    else
+      capture.Stop();
+  });
+  ui.setRenderMode((int)opts.renderMode);
+  ui.setOnRenderModeChanged(
+      [&](int m) { fluid.SetRenderMode((ParticleRenderMode)m); });
 
   double lastTime = glfwGetTime();
+  AllocStats lastAllocs = ReadAllocStats();
 
+  // Each stage runs under the allocation tag of its subsystem; the overlay
+  // shows the previous frame's counts.
   while (!glfwWindowShouldClose(window)) {
     glfwPollEvents();
 
+    AllocStats allocs = ReadAllocStats();
+    ui.setFrameAllocations(allocs - lastAllocs);
+    lastAllocs = allocs;
+
     double now = glfwGetTime();
     float dt = static_cast<float>(now - lastTime);
     lastTime = now;
 
-    ui.NewFrame();
+    {
+      AllocTagScope tag(AllocTag::Ui);
+      ui.NewFrame();
+    }
 
-    fluid.Update(dt);
+    if (player.IsOpen()) {
+      AllocTagScope tag(AllocTag::Upload);
+      if (player.Advance(dt))
+        showPlaybackFrame();
+    } else {
+      {
+        AllocTagScope tag(AllocTag::Solver);
+        fluid.Update(dt);
+      }
+      if (recorder.IsOpen() && fluid.GetRunning())
+        recorder.Capture(fluid.GetInstances(), fluid.GetFrameTime());
+    }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
-    glViewport(0, 0, sceneW, sceneH);
-    glClearColor(0.13f, 0.15f, 0.19f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+    {
+      AllocTagScope tag(AllocTag::Gl);
+      DrawScene(target, fluid, player, playbackRenderer.get());
+      capture.Update();
 
-    fluid.RenderScene(sceneProg, uColor);
-    fluid.RenderParticles(particleProg, uRadius, uColorLow, uColorHigh);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      int dw, dh;
+      glfwGetFramebufferSize(window, &dw, &dh);
+      glViewport(0, 0, dw, dh);
+      glClearColor(0.08f, 0.08f, 0.10f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
 
-    int dw, dh;
-    glfwGetFramebufferSize(window, &dw, &dh);
-    glViewport(0, 0, dw, dh);
-    glClearColor(0.08f, 0.08f, 0.10f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    ui.Render(fluid.GetParticleCount());
+    {
+      AllocTagScope tag(AllocTag::Ui);
+      MemoryReport mem = fluid.GetMemoryReport();
+      ui.setMemoryInfo(mem.CpuTotal(), mem.gpuBytes);
+      ui.setDrainedCount(fluid.GetDrainedCount());
+      ui.setSleepingCount(fluid.GetSleepingCount());
+      ui.setLevelCounts(fluid.GetLevelCount(0), fluid.GetLevelCount(1),
+                        fluid.GetLevelCount(2));
+      ui.setPerfCounters(fluid.GetPerfCounters(), fluid.GetPerfError(),
+                         fluid.GetPerfTotal());
+      ui.setRecording(recorder.IsOpen(), recorder.GetStats());
+      ui.setPlayback(player);
+      ui.setCapture(capture.IsCapturing(), capture.GetStats());
+      ui.Render(player.IsOpen() ? (int)player.GetInstances().size()
+                                : fluid.GetParticleCount());
+    }
 
+    AllocTagScope tag(AllocTag::Gl);
     glfwSwapBuffers(window);
   }
 
-  glDeleteProgram(particleProg);
-  glDeleteProgram(sceneProg);
-  glDeleteFramebuffers(1, &sceneFbo);
-  glDeleteTextures(1, &sceneTex);
+  if (recorder.IsOpen() && recorder.Close())
+    PrintTrajectoryStats(recorder);
+  playbackRenderer.reset();
+  capture.Shutdown();
   ui.Shutdown();
-  glfwDestroyWindow(window);
-  glfwTerminate();
   return 0;
 }
@@ -0,0 +1,204 @@
+#include "AppOptions.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static void PrintUsage(const char *exe) {
+  std::cerr
+      << "usage: " << exe << " [options]\n"
+      << "  --impostor fan|quad|point  particle impostor mode (default quad)\n"
+      << "  --scene FILE               load a scene (.txt polylines or .svg)\n"
+      << "  --checkpoint FILE          start from a saved solver state\n"
+      << "  --save-checkpoint FILE     save the state after --headless steps\n"
+      << "  --record FILE              stream every simulated frame to a\n"
+      << "                             compressed trajectory file\n"
+      << "  --play FILE                play back a recorded trajectory; with\n"
+      << "                             --headless, time decoding and seeking\n"
+      << "  --boundary sdf|exact       boundary queries: baked SDF or BVH\n"
+      << "  --no-boundary-particles    disable wall/obstacle SPH samples\n"
+      << "  --collisions gs|jacobi     sequential or parallel contact pass\n"
+      << "  --kernel muller|wendland|cubic\n"
+      << "                             SPH smoothing kernel (default muller)\n"
+      << "  --precision float|double   density and force accumulators\n"
+      << "  --capacity N               maximum particle count (default 550)\n"
+      << "  --memory-table             print memory use per capacity and exit\n"
+      << "  --threads N                solver threads (default: all cores)\n"
+      << "  --isa generic|sse4.2|avx2|avx512\n"
+      << "                             force a solver code path (default:\n"
+      << "                             best the CPU supports)\n"
+      << "  --headless                 simulate without a window and exit\n"
+      << "  --render-frames DIR        render each simulated or --play frame\n"
+      << "                             to images in DIR and exit (the window\n"
+      << "                             stays hidden)\n"
+      << "  --image-format png|ppm     image type for --render-frames (png)\n"
+      << "  --y4m FILE                 like --render-frames, into one Y4M\n"
+      << "                             video stream (- for stdout)\n"
+      << "  --steps N                  frames of 1/60 s for --headless,\n"
+      << "                             --render-frames and --y4m (600)\n"
+      << "  --checksum                 print a particle state checksum per\n"
+      << "                             --headless step\n"
+      << "  --alloc-csv FILE           write heap allocations per --headless\n"
+      << "                             step and subsystem as CSV\n"
+      << "  --perf                     hardware counters per solver phase\n"
+      << "                             (Linux perf_event_open)\n"
+      << "  --init SHAPE               initial block: dambreak|box|lattice|\n"
+      << "                             jitter|poisson\n"
+      << "  --init-count N             particles for --init (default 2000)\n"
+      << "  --init-seed N              seed for --init (default 1)\n"
+      << "  --relax-iters N            settling steps after --init (240)\n"
+      << "  --context glfw|egl         OpenGL context from a window (default)\n"
+      << "                             or from EGL without a display; egl\n"
+      << "                             needs --bench-render, --render-frames\n"
+      << "                             or --y4m\n"
+      << "  --bench-render [N]         render benchmark with N particles\n"
+      << "                             (default 100000) and exit\n"
+      << "  --bench-frames N           frames per benchmark mode (60)\n";
+}
+
+static bool ParseRenderMode(const char *s, ParticleRenderMode &out) {
+  if (!std::strcmp(s, "fan"))
+    out = ParticleRenderMode::TriangleFan;
+  else if (!std::strcmp(s, "quad"))
+    out = ParticleRenderMode::Quad;
+  else if (!std::strcmp(s, "point"))
+    out = ParticleRenderMode::Point;
+  else
+    return false;
+  return true;
+}
+
+bool ParseAppOptions(int argc, char **argv, AppOptions &out) {
+  for (int i = 1; i < argc; ++i) {
+    const char *a = argv[i];
+    bool hasNext = i + 1 < argc;
+    if (!std::strcmp(a, "--impostor") && hasNext) {
+      if (!ParseRenderMode(argv[++i], out.renderMode)) {
+        PrintUsage(argv[0]);
+        return false;
+      }
+    } else if (!std::strcmp(a, "--scene") && hasNext) {
+      out.scenePath = argv[++i];
+    } else if (!std::strcmp(a, "--checkpoint") && hasNext) {
+      out.checkpointPath = argv[++i];
+    } else if (!std::strcmp(a, "--save-checkpoint") && hasNext) {
+      out.saveCheckpointPath = argv[++i];
+    } else if (!std::strcmp(a, "--record") && hasNext) {
+      out.recordPath = argv[++i];
+    } else if (!std::strcmp(a, "--play") && hasNext) {
+      out.playPath = argv[++i];
+    } else if (!std::strcmp(a, "--boundary") && hasNext) {
+      const char *m = argv[++i];
+      if (!std::strcmp(m, "sdf")) {
+        out.boundaryMode = BoundaryMode::Sdf;
+      } else if (!std::strcmp(m, "exact")) {
+        out.boundaryMode = BoundaryMode::Exact;
+      } else {
+        PrintUsage(argv[0]);
+        return false;
+      }
+    } else if (!std::strcmp(a, "--collisions") && hasNext) {
+      const char *m = argv[++i];
+      if (!std::strcmp(m, "gs")) {
+        out.collisionMode = CollisionMode::GaussSeidel;
+      } else if (!std::strcmp(m, "jacobi")) {
+        out.collisionMode = CollisionMode::Jacobi;
+      } else {
+        PrintUsage(argv[0]);
+        return false;
+      }
+    } else if (!std::strcmp(a, "--kernel") && hasNext) {
+      const char *m = argv[++i];
+      if (!std::strcmp(m, "muller")) {
+        out.kernel = KernelFamily::Muller;
+      } else if (!std::strcmp(m, "wendland")) {
+        out.kernel = KernelFamily::Wendland;
+      } else if (!std::strcmp(m, "cubic")) {
+        out.kernel = KernelFamily::CubicSpline;
+      } else {
+        PrintUsage(argv[0]);
+        return false;
+      }
+    } else if (!std::strcmp(a, "--precision") && hasNext) {
+      const char *m = argv[++i];
+      if (!std::strcmp(m, "float")) {
+        out.precision = Precision::Float;
+      } else if (!std::strcmp(m, "double")) {
+        out.precision = Precision::Double;
+      } else {
+        PrintUsage(argv[0]);
+        return false;
+      }
+    } else if (!std::strcmp(a, "--no-boundary-particles")) {
+      out.boundaryParticles = false;
+    } else if (!std::strcmp(a, "--capacity") && hasNext) {
+      out.capacity = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(a, "--memory-table")) {
+      out.memoryTable = true;
+    } else if (!std::strcmp(a, "--threads") && hasNext) {
+      out.threads = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(a, "--isa") && hasNext) {
+      if (!ParseCpuIsa(argv[++i], out.isa)) {
+        PrintUsage(argv[0]);
+        return false;
+      }
+      out.isaOverride = true;
+    } else if (!std::strcmp(a, "--headless")) {
+      out.headless = true;
+    } else if (!std::strcmp(a, "--render-frames") && hasNext) {
+      out.framesDir = argv[++i];
+    } else if (!std::strcmp(a, "--image-format") && hasNext) {
+      const char *m = argv[++i];
+      if (!std::strcmp(m, "png")) {
+        out.imageFormat = ImageFormat::Png;
+      } else if (!std::strcmp(m, "ppm")) {
+        out.imageFormat = ImageFormat::Ppm;
+      } else {
+        PrintUsage(argv[0]);
+        return false;
+      }
+    } else if (!std::strcmp(a, "--y4m") && hasNext) {
+      out.videoPath = argv[++i];
+    } else if (!std::strcmp(a, "--steps") && hasNext) {
+      out.steps = std::max(0, std::atoi(argv[++i]));
+    } else if (!std::strcmp(a, "--checksum")) {
+      out.checksum = true;
+    } else if (!std::strcmp(a, "--alloc-csv") && hasNext) {
+      out.allocCsvPath = argv[++i];
+    } else if (!std::strcmp(a, "--perf")) {
+      out.perf = true;
+    } else if (!std::strcmp(a, "--init") && hasNext) {
+      if (!ParseInitShape(argv[++i], out.initShape)) {
+        PrintUsage(argv[0]);
+        return false;
+      }
+      out.initEnabled = true;
+    } else if (!std::strcmp(a, "--init-count") && hasNext) {
+      out.initCount = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(a, "--init-seed") && hasNext) {
+      out.initSeed = std::atoi(argv[++i]);
+    } else if (!std::strcmp(a, "--relax-iters") && hasNext) {
+      out.relaxIterations = std::max(0, std::atoi(argv[++i]));
+    } else if (!std::strcmp(a, "--context") && hasNext) {
+      const char *m = argv[++i];
+      if (!std::strcmp(m, "glfw")) {
+        out.context = GlBackend::Glfw;
+      } else if (!std::strcmp(m, "egl")) {
+        out.context = GlBackend::Egl;
+      } else {
+        PrintUsage(argv[0]);
+        return false;
+      }
+    } else if (!std::strcmp(a, "--bench-render")) {
+      out.benchRender = true;
+      if (hasNext && argv[i + 1][0] != '-')
+        out.benchParticles = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(a, "--bench-frames") && hasNext) {
+      out.benchFrames = std::max(1, std::atoi(argv[++i]));
+    } else {
+      PrintUsage(argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
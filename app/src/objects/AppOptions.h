@@ -0,0 +1,51 @@
+#pragma once
+#include "EglContext.h"
+#include "FluidSim.h"
+#include "ImageSequence.h"
+#include "ParticleRenderer.h"
+#include <string>
+
+struct AppOptions {
+  ParticleRenderMode renderMode = ParticleRenderMode::Quad;
+  BoundaryMode boundaryMode = BoundaryMode::Sdf;
+  CollisionMode collisionMode = CollisionMode::GaussSeidel;
+  KernelFamily kernel = KernelFamily::Muller;
+  Precision precision = Precision::Float;
+  std::string scenePath;
+  std::string checkpointPath;     // loaded after the other settings
+  std::string saveCheckpointPath; // written after --headless steps
+  std::string recordPath;         // trajectory of every running frame
+  std::string playPath;           // trajectory shown instead of the solver
+  bool boundaryParticles = true;
+  int capacity = 550;
+  bool memoryTable = false;
+
+  bool initEnabled = false;
+  InitShape initShape = InitShape::DamBreak;
+  int initCount = 2000;
+  int initSeed = 1;
+  int relaxIterations = 240;
+
+  int threads = 0; // 0 = one per hardware thread
+  bool isaOverride = false;
+  CpuIsa isa = CpuIsa::Generic;
+
+  bool headless = false;
+  int steps = 600;
+  bool checksum = false;
+  std::string allocCsvPath; // per-step heap counts for --headless
+  bool perf = false;        // hardware counters per solver phase
+
+  std::string framesDir; // offline rendering to an image sequence
+  ImageFormat imageFormat = ImageFormat::Png;
+  std::string videoPath; // offline rendering to a Y4M stream, "-" = stdout
+
+  GlBackend context = GlBackend::Glfw;
+
+  bool benchRender = false;
+  int benchParticles = 100000;
+  int benchFrames = 60;
+};
+
+// Returns false (after printing usage) on unknown or malformed arguments.
+bool ParseAppOptions(int argc, char **argv, AppOptions &out);
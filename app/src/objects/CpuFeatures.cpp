@@ -0,0 +1,103 @@
+#include "CpuFeatures.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPU_FEATURES_X86 1
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef CPU_FEATURES_X86
+static void Cpuid(uint32_t leaf, uint32_t sub, uint32_t r[4]) {
+#if defined(_MSC_VER)
+  int v[4];
+  __cpuidex(v, (int)leaf, (int)sub);
+  for (int i = 0; i < 4; ++i)
+    r[i] = (uint32_t)v[i];
+#else
+  __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+static uint64_t Xgetbv0() {
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t lo, hi;
+  __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+static CpuIsa Detect() {
+  uint32_t r[4];
+  Cpuid(0, 0, r);
+  uint32_t maxLeaf = r[0];
+  Cpuid(1, 0, r);
+  uint32_t ecx1 = r[2];
+  auto bit = [](uint32_t reg, int b) { return (reg >> b) & 1u; };
+
+  // SSE3, SSSE3, SSE4.1, SSE4.2, POPCNT
+  if (!(bit(ecx1, 0) && bit(ecx1, 9) && bit(ecx1, 19) && bit(ecx1, 20) &&
+        bit(ecx1, 23)))
+    return CpuIsa::Generic;
+  CpuIsa isa = CpuIsa::Sse42;
+
+  // AVX needs the OS to save XMM/YMM state (OSXSAVE, XCR0 bits 1-2).
+  if (!bit(ecx1, 27) || maxLeaf < 7)
+    return isa;
+  uint64_t xcr0 = Xgetbv0();
+  Cpuid(7, 0, r);
+  uint32_t ebx7 = r[1];
+  // AVX, FMA, F16C, MOVBE; AVX2, BMI1, BMI2
+  bool avx2 = (xcr0 & 0x6) == 0x6 && bit(ecx1, 28) && bit(ecx1, 12) &&
+              bit(ecx1, 29) && bit(ecx1, 22) && bit(ebx7, 5) &&
+              bit(ebx7, 3) && bit(ebx7, 8);
+  if (!avx2)
+    return isa;
+  isa = CpuIsa::Avx2;
+
+  // AVX-512 F, DQ, CD, BW, VL plus opmask and ZMM state (XCR0 bits 5-7).
+  bool avx512 = (xcr0 & 0xe6) == 0xe6 && bit(ebx7, 16) && bit(ebx7, 17) &&
+                bit(ebx7, 28) && bit(ebx7, 30) && bit(ebx7, 31);
+  if (avx512)
+    isa = CpuIsa::Avx512;
+  return isa;
+}
+#else
+static CpuIsa Detect() { return CpuIsa::Generic; }
+#endif
+
+CpuIsa DetectCpuIsa() {
+  static const CpuIsa isa = Detect();
+  return isa;
+}
+
+const char *CpuIsaName(CpuIsa isa) {
+  switch (isa) {
+  case CpuIsa::Generic:
+    return "generic";
+  case CpuIsa::Sse42:
+    return "sse4.2";
+  case CpuIsa::Avx2:
+    return "avx2";
+  case CpuIsa::Avx512:
+    return "avx512";
+  }
+  return "?";
+}
+
+bool ParseCpuIsa(const char *name, CpuIsa &out) {
+  for (int i = 0; i < CpuIsaCount; ++i) {
+    if (!std::strcmp(name, CpuIsaName((CpuIsa)i))) {
+      out = (CpuIsa)i;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// Instruction set levels the solver's hot passes are compiled for. Each
+// level includes the previous ones; they follow the x86-64 psABI levels
+// v2 (SSE4.2), v3 (AVX2, FMA) and v4 (AVX-512 F/BW/CD/DQ/VL).
+enum class CpuIsa { Generic = 0, Sse42 = 1, Avx2 = 2, Avx512 = 3 };
+inline constexpr int CpuIsaCount = 4;
+
+// Highest level both the CPU and the OS (saved vector state) support, from
+// cpuid; Generic on other architectures. Computed once.
+CpuIsa DetectCpuIsa();
+
+// "generic", "sse4.2", "avx2" or "avx512".
+const char *CpuIsaName(CpuIsa isa);
+bool ParseCpuIsa(const char *name, CpuIsa &out);
+
+// For templates that call back into the ISA-specific solver passes
+// (FluidSimPasses.h). They are defined for the baseline target, which
+// could not inline a callback built for a wider one; forced inlining
+// puts the whole loop into the pass instead.
+#if defined(__GNUC__)
+#define FLUID_PASS_INLINE [[gnu::always_inline]] inline
+#else
+#define FLUID_PASS_INLINE inline
+#endif
@@ -0,0 +1,175 @@
+#include "EglContext.h"
+#include <iostream>
+
+#ifdef __linux__
+#include <cstdint>
+#include <cstring>
+#include <dlfcn.h>
+
+// The few EGL 1.5 names used here, so no EGL headers are needed.
+namespace {
+
+using EGLint = int32_t;
+using EGLBoolean = unsigned int;
+using EGLenum = unsigned int;
+using EGLDisplay = void *;
+using EGLConfig = void *;
+using EGLContext = void *;
+using EGLSurface = void *;
+
+constexpr EGLint eglNone = 0x3038;
+constexpr EGLint eglSurfaceType = 0x3033;
+constexpr EGLint eglPbufferBit = 0x0001;
+constexpr EGLint eglRenderableType = 0x3040;
+constexpr EGLint eglOpenGlBit = 0x0008;
+constexpr EGLenum eglOpenGlApi = 0x30a2;
+constexpr EGLint eglExtensions = 0x3055;
+constexpr EGLint eglContextMajorVersion = 0x3098;
+constexpr EGLint eglContextMinorVersion = 0x30fb;
+constexpr EGLint eglContextProfileMask = 0x30fd;
+constexpr EGLint eglContextCoreProfileBit = 0x0001;
+constexpr EGLenum eglPlatformSurfacelessMesa = 0x31dd;
+
+struct EglApi {
+  void *(*getProcAddress)(const char *);
+  EGLint (*getError)();
+  EGLDisplay (*getDisplay)(void *);
+  EGLBoolean (*initialize)(EGLDisplay, EGLint *, EGLint *);
+  EGLBoolean (*terminate)(EGLDisplay);
+  const char *(*queryString)(EGLDisplay, EGLint);
+  EGLBoolean (*bindApi)(EGLenum);
+  EGLBoolean (*chooseConfig)(EGLDisplay, const EGLint *, EGLConfig *, EGLint,
+                             EGLint *);
+  EGLContext (*createContext)(EGLDisplay, EGLConfig, EGLContext,
+                              const EGLint *);
+  EGLBoolean (*destroyContext)(EGLDisplay, EGLContext);
+  EGLBoolean (*makeCurrent)(EGLDisplay, EGLSurface, EGLSurface, EGLContext);
+};
+
+EglApi egl; // set by EglContext::Create
+
+bool HasExtension(const char *list, const char *name) {
+  size_t n = std::strlen(name);
+  for (const char *p = list; p && (p = std::strstr(p, name)); p += n)
+    if ((p == list || p[-1] == ' ') && (p[n] == ' ' || p[n] == '\0'))
+      return true;
+  return false;
+}
+
+template <typename F> bool Load(void *library, const char *name, F &fn) {
+  fn = (F)dlsym(library, name);
+  if (!fn)
+    std::cerr << "libEGL has no " << name << "\n";
+  return fn != nullptr;
+}
+
+} // namespace
+
+bool EglContext::Create(int major, int minor) {
+  Destroy();
+  library_ = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+  if (!library_) {
+    std::cerr << "Cannot load libEGL.so.1: " << dlerror() << "\n";
+    return false;
+  }
+  if (!Load(library_, "eglGetProcAddress", egl.getProcAddress) ||
+      !Load(library_, "eglGetError", egl.getError) ||
+      !Load(library_, "eglGetDisplay", egl.getDisplay) ||
+      !Load(library_, "eglInitialize", egl.initialize) ||
+      !Load(library_, "eglTerminate", egl.terminate) ||
+      !Load(library_, "eglQueryString", egl.queryString) ||
+      !Load(library_, "eglBindAPI", egl.bindApi) ||
+      !Load(library_, "eglChooseConfig", egl.chooseConfig) ||
+      !Load(library_, "eglCreateContext", egl.createContext) ||
+      !Load(library_, "eglDestroyContext", egl.destroyContext) ||
+      !Load(library_, "eglMakeCurrent", egl.makeCurrent)) {
+    Destroy();
+    return false;
+  }
+
+  // Client extensions are queried without a display.
+  const char *client = egl.queryString(nullptr, eglExtensions);
+  using GetPlatformDisplay = EGLDisplay (*)(EGLenum, void *, const EGLint *);
+  auto getPlatformDisplay =
+      (GetPlatformDisplay)egl.getProcAddress("eglGetPlatformDisplayEXT");
+  if (getPlatformDisplay &&
+      HasExtension(client, "EGL_MESA_platform_surfaceless"))
+    display_ = getPlatformDisplay(eglPlatformSurfacelessMesa, nullptr,
+                                  nullptr);
+  if (!display_)
+    display_ = egl.getDisplay(nullptr);
+  EGLint eglMajor = 0, eglMinor = 0;
+  if (!display_ || !egl.initialize(display_, &eglMajor, &eglMinor)) {
+    std::cerr << "eglInitialize failed (0x" << std::hex << egl.getError()
+              << std::dec << ")\n";
+    display_ = nullptr;
+    Destroy();
+    return false;
+  }
+  if (!HasExtension(egl.queryString(display_, eglExtensions),
+                    "EGL_KHR_surfaceless_context")) {
+    std::cerr << "EGL display lacks EGL_KHR_surfaceless_context\n";
+    Destroy();
+    return false;
+  }
+
+  const EGLint configAttribs[] = {eglSurfaceType, eglPbufferBit,
+                                  eglRenderableType, eglOpenGlBit, eglNone};
+  EGLConfig config = nullptr;
+  EGLint configs = 0;
+  if (!egl.bindApi(eglOpenGlApi) ||
+      !egl.chooseConfig(display_, configAttribs, &config, 1, &configs) ||
+      configs < 1) {
+    std::cerr << "No EGL config for desktop OpenGL\n";
+    Destroy();
+    return false;
+  }
+  const EGLint contextAttribs[] = {eglContextMajorVersion,
+                                   major,
+                                   eglContextMinorVersion,
+                                   minor,
+                                   eglContextProfileMask,
+                                   eglContextCoreProfileBit,
+                                   eglNone};
+  context_ = egl.createContext(display_, config, nullptr, contextAttribs);
+  if (!context_ || !egl.makeCurrent(display_, nullptr, nullptr, context_)) {
+    std::cerr << "Cannot create an OpenGL " << major << "." << minor
+              << " core context with EGL (0x" << std::hex << egl.getError()
+              << std::dec << ")\n";
+    Destroy();
+    return false;
+  }
+  return true;
+}
+
+void EglContext::Destroy() {
+  if (display_) {
+    egl.makeCurrent(display_, nullptr, nullptr, nullptr);
+    if (context_)
+      egl.destroyContext(display_, context_);
+    egl.terminate(display_);
+  }
+  context_ = nullptr;
+  display_ = nullptr;
+  if (library_)
+    dlclose(library_);
+  library_ = nullptr;
+  egl = {};
+}
+
+void *EglContext::GetProcAddress(const char *name) {
+  return egl.getProcAddress ? egl.getProcAddress(name) : nullptr;
+}
+
+#else
+
+bool EglContext::Create(int, int) {
+  std::cerr << "EGL contexts are only supported on Linux\n";
+  return false;
+}
+
+void EglContext::Destroy() {}
+
+void *EglContext::GetProcAddress(const char *) { return nullptr; }
+
+#endif
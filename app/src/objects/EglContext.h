@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+
+// Where the OpenGL context comes from: a GLFW window, or EGL without any
+// window system (--context egl), for machines without a display.
+enum class GlBackend { Glfw = 0, Egl = 1 };
+
+// An OpenGL core profile context on an EGL display with no surface, made
+// current on the calling thread. Everything renders into framebuffer
+// objects, so besides the window and UI the GL code runs unchanged, e.g.
+// on Mesa llvmpipe in CI. Prefers the surfaceless platform
+// (EGL_MESA_platform_surfaceless) and falls back to the default display.
+// libEGL is loaded at run time, so the program neither links against it
+// nor needs it unless this backend is used. Linux only.
+class EglContext {
+public:
+  EglContext() = default;
+  ~EglContext() { Destroy(); }
+  EglContext(const EglContext &) = delete;
+  EglContext &operator=(const EglContext &) = delete;
+
+  // Prints the reason and returns false on failure.
+  bool Create(int major, int minor);
+  void Destroy();
+  // For gladLoadGLLoader(), once Create() has succeeded.
+  static void *GetProcAddress(const char *name);
+
+private:
+  void *library_ = nullptr;
+  void *display_ = nullptr;
+  void *context_ = nullptr;
+};
@@ -1,187 +1,646 @@
 #include "FluidSim.h"
+#include "HeapCounter.h"
+#include "JobSystem.h"
+#include "SphKernels.h"
 #include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <cstring>
 #include <glad/glad.h>
 #include <random>
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
+FluidSim::FluidSim(bool graphics) : graphics_(graphics) {
+  SelectPasses();
+  SetCapacity(capacity_);
+  SetRenderRadius(renderRadius_);
+  BuildBoundarySdf();
+  InitParticleGL();
+  InitSceneGL();
+  ResetEmitters();
+}
 
-float FluidSim::Poly6(float r2) const {
-  float h2 = h_ * h_;
-  if (r2 >= h2)
-    return 0.0f;
-  float f = h2 - r2;
-  return (4.0f / ((float)M_PI * std::pow(h_, 8.0f))) * f * f * f;
+FluidSim::~FluidSim() {
+  if (sceneVAO_)
+    glDeleteVertexArrays(1, &sceneVAO_);
+  if (sceneVBO_)
+    glDeleteBuffers(1, &sceneVBO_);
 }
 
-glm::vec2 FluidSim::SpikyGrad(glm::vec2 r_vec, float r_len) const {
-  if (r_len <= 0.0f || r_len >= h_)
-    return glm::vec2(0.0f);
-  float f = h_ - r_len;
-  float coeff = -(30.0f / ((float)M_PI * std::pow(h_, 5.0f))) * f * f;
-  return coeff * (r_vec / r_len);
+void FluidSim::AddObstacle(const std::vector<glm::vec2> &polygon) {
+  if (polygon.size() < 3)
+    return;
+  scene_.polygons.push_back(polygon);
+  BuildBoundarySdf();
+  InitSceneGL();
 }
 
-float FluidSim::ViscLaplacian(float r_len) const {
-  if (r_len >= h_)
-    return 0.0f;
-  return (40.0f / ((float)M_PI * std::pow(h_, 5.0f))) * (h_ - r_len);
+void FluidSim::ClearObstacles() {
+  scene_.polygons.clear();
+  scene_.polylines.clear();
+  BuildBoundarySdf();
+  InitSceneGL();
 }
 
-FluidSim::FluidSim() {
-  particles_.reserve(maxParticles_);
-  InitParticleGL();
+void FluidSim::LoadScene(const Scene &scene) {
+  scene_ = scene;
+  gridReady_ = false;
+  WakeAll();
+  BuildBoundarySdf();
   InitSceneGL();
+  Reset();
 }
 
-FluidSim::~FluidSim() {
-  if (particleVAO_)
-    glDeleteVertexArrays(1, &particleVAO_);
-  if (circleVBO_)
-    glDeleteBuffers(1, &circleVBO_);
-  if (instanceVBO_)
-    glDeleteBuffers(1, &instanceVBO_);
-  if (sceneVAO_)
-    glDeleteVertexArrays(1, &sceneVAO_);
-  if (sceneVBO_)
-    glDeleteBuffers(1, &sceneVBO_);
+void FluidSim::BuildBoundarySdf() {
+  glm::vec2 pad = (scene_.containerMax - scene_.containerMin) * 0.1f;
+  sdf_.SetDomain(scene_.containerMin - pad, scene_.containerMax + pad,
+                 scene_.sdfResolution);
+  sdf_.SetContainer(scene_.containerMin, scene_.containerMax);
+  sdf_.ClearGeometry();
+  for (const auto &poly : scene_.polygons)
+    sdf_.AddPolygon(poly);
+  for (const auto &line : scene_.polylines)
+    sdf_.AddPolyline(line.pts, line.thickness);
+  sdf_.Build();
+  BuildBoundaryParticles();
 }
 
-void FluidSim::Reset() {
-  particles_.clear();
-  spawnTimer_ = 0.0f;
+float FluidSim::LatticeDensity(float spacing) const {
+  // Density at a site of an infinite square lattice, self term included.
+  float rho = 0.0f;
+  int k = (int)std::ceil(h_ / spacing);
+  for (int y = -k; y <= k; ++y)
+    for (int x = -k; x <= k; ++x) {
+      glm::vec2 r = glm::vec2((float)x, (float)y) * spacing;
+      rho += mass_ * KernelW(glm::dot(r, r));
+    }
+  return rho;
 }
 
-void FluidSim::Update(float dt) {
-  if (!running_)
+float FluidSim::SpacingForDensity(float density) const {
+  // LatticeDensity falls monotonically with spacing; bisect between the
+  // collision distance and the kernel radius. Targets outside that range
+  // (e.g. below the kernel's self term) clamp to the nearest end.
+  float lo = 2.0f * particleRadius_, hi = h_;
+  if (LatticeDensity(hi) >= density)
+    return hi;
+  if (LatticeDensity(lo) <= density)
+    return lo;
+  for (int i = 0; i < 32; ++i) {
+    float mid = 0.5f * (lo + hi);
+    if (LatticeDensity(mid) > density)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return 0.5f * (lo + hi);
+}
+
+void FluidSim::BuildNeighborGrid() {
+  float cell = GridCellSize();
+  if (cell != grid_.GetCellSize() || !gridReady_) {
+    glm::vec2 pad = (scene_.containerMax - scene_.containerMin) * 0.1f;
+    grid_.SetDomain(scene_.containerMin - pad, scene_.containerMax + pad,
+                    cell);
+    cellState_.reserve(grid_.GetCellCount());
+    gridReady_ = true;
+  }
+  grid_.Build((int)particles_.size(),
+              [this](int i) { return particles_[i].pos; });
+}
+
+void FluidSim::BuildBoundaryParticles() {
+  boundaryPos_.clear();
+  const float spacing = 0.5f * h_;
+  auto sampleLine = [&](glm::vec2 a, glm::vec2 b) {
+    float len = glm::length(b - a);
+    int steps = std::max(1, (int)std::ceil(len / spacing));
+    for (int s = 0; s <= steps; ++s)
+      boundaryPos_.push_back(a + (b - a) * ((float)s / steps));
+  };
+
+  glm::vec2 lo = scene_.containerMin, hi = scene_.containerMax;
+  sampleLine(lo, {hi.x, lo.y});
+  sampleLine({hi.x, lo.y}, hi);
+  sampleLine(hi, {lo.x, hi.y});
+  sampleLine({lo.x, hi.y}, lo);
+
+  // Polygon edges are sampled on the edge, thick walls on both faces.
+  for (const auto &s : sdf_.GetBvh().GetSegments()) {
+    if (s.radius <= 0.0f) {
+      sampleLine(s.a, s.b);
+      continue;
+    }
+    glm::vec2 d = s.b - s.a;
+    float len = glm::length(d);
+    if (len < 1e-7f)
+      continue;
+    glm::vec2 n = glm::vec2(-d.y, d.x) * (s.radius / len);
+    sampleLine(s.a + n, s.b + n);
+    sampleLine(s.a - n, s.b - n);
+  }
+
+  glm::vec2 pad = (hi - lo) * 0.1f;
+  boundaryGrid_.SetDomain(lo - pad, hi + pad, h_);
+  boundaryGrid_.Build((int)boundaryPos_.size(),
+                      [this](int i) { return boundaryPos_[i]; });
+
+  // V_b = 1 / sum_k W(x_b - x_k); rho_0 is set in SetRenderRadius.
+  boundaryVolume_.resize(boundaryPos_.size());
+  for (size_t b = 0; b < boundaryPos_.size(); ++b) {
+    float sumW = 0.0f;
+    boundaryGrid_.ForEachNeighbor(boundaryPos_[b], [&](int k) {
+      glm::vec2 r = boundaryPos_[b] - boundaryPos_[k];
+      sumW += KernelW(glm::dot(r, r));
+    });
+    boundaryVolume_[b] = 1.0f / std::max(sumW, 1e-6f);
+  }
+}
+
+void FluidSim::SetRenderRadius(float r) {
+  renderRadius_ = r;
+  particleRadius_ = r;
+  // The fluid packs to collision spacing, so that lattice density (not the
+  // nominal restDensity_) is the rho_0 boundary samples must stand in for.
+  boundaryRho0_ = LatticeDensity(2.0f * particleRadius_);
+  WakeAll();
+}
+
+void FluidSim::SetKernel(KernelFamily k) {
+  kernel_ = k;
+  SelectPasses();
+  BuildBoundaryParticles();
+  SetRenderRadius(renderRadius_);
+}
+
+float FluidSim::KernelW(float r2) const {
+  switch (kernel_) {
+  case KernelFamily::Wendland:
+    return WendlandKernels(h_).W(r2);
+  case KernelFamily::CubicSpline:
+    return CubicSplineKernels(h_).W(r2);
+  default:
+    return MullerKernels(h_).W(r2);
+  }
+}
+
+void FluidSim::SetIsa(CpuIsa isa) {
+  isa_ = std::min(isa, DetectCpuIsa());
+  SelectPasses();
+}
+
+void FluidSim::SelectPasses() {
+  static const PassTable tables[CpuIsaCount] = {
+      MakePassTable<CpuIsa::Generic>(), MakePassTable<CpuIsa::Sse42>(),
+      MakePassTable<CpuIsa::Avx2>(), MakePassTable<CpuIsa::Avx512>()};
+  const PassTable &t = tables[(int)isa_];
+  int k = (int)kernel_, p = (int)precision_, b = (int)boundaryMode_;
+  passes_.density = t.density[k][p];
+  passes_.forces = t.forces[k][p];
+  passes_.integrate = t.integrate;
+  passes_.integrateAndPack = t.integrateAndPack[b];
+  passes_.enforceBoundaries = t.enforceBoundaries[b];
+}
+
+void FluidSim::SetCapacity(int capacity) {
+  capacity_ = std::clamp(capacity, 1, maxCapacity);
+  if ((int)particles_.size() > capacity_) {
+    particles_.resize(capacity_);
+    handles_.Truncate(capacity_);
+  }
+  if ((int)instances_.size() > capacity_)
+    instances_.resize(capacity_);
+  // reserve() only ever grows; shrinking keeps the allocation for reuse.
+  particles_.reserve(capacity_);
+  instances_.reserve(capacity_);
+  handles_.Reserve(capacity_);
+  grid_.Reserve(capacity_);
+  asleep_.reserve(capacity_);
+  rateMask_.reserve(capacity_);
+  arena_.Reserve(ScratchBytes(capacity_));
+  if (renderer_)
+    renderer_->Reserve(capacity_);
+}
+
+MemoryReport FluidSim::GetMemoryReport() const {
+  MemoryReport r;
+  r.capacity = capacity_;
+  r.particleBytes =
+      particles_.capacity() * sizeof(Particle) + handles_.GetBytes();
+  r.instanceBytes = instances_.capacity() * sizeof(glm::vec3);
+  r.gridBytes = grid_.GetBytes();
+  r.scratchBytes = arena_.GetBytes();
+  r.boundaryBytes = boundaryPos_.capacity() * sizeof(glm::vec2) +
+                    boundaryVolume_.capacity() * sizeof(float) +
+                    boundaryGrid_.GetBytes();
+  r.gpuBytes = renderer_ ? renderer_->GetGpuBytes() : 0;
+  return r;
+}
+
+int FluidSim::EstimateCellCount() const {
+  // Same padded domain as BuildNeighborGrid.
+  float cell = GridCellSize();
+  glm::vec2 ext = (scene_.containerMax - scene_.containerMin) * 1.2f;
+  return (int)(std::ceil(ext.x / cell) * std::ceil(ext.y / cell));
+}
+
+size_t FluidSim::ScratchBytes(int capacity) const {
+  size_t chunks = (capacity + packGrain_ - 1) / packGrain_;
+  size_t bytes = chunks * sizeof(float) +
+                 (size_t)capacity * sizeof(CollisionDelta) +
+                 (size_t)EstimateCellCount() * sizeof(CellSample);
+  return ScratchArena::EstimateBytes(bytes, 3);
+}
+
+void FluidSim::ResetScratch() {
+  arena_.Reset();
+  chunkMaxSpeed_ = {};
+  collisionDelta_ = {};
+  cellSamples_ = {};
+}
+
+MemoryReport FluidSim::EstimateMemory(int capacity) const {
+  MemoryReport r;
+  r.capacity = capacity;
+  r.particleBytes = (size_t)capacity * sizeof(Particle) +
+                    ParticleHandles::EstimateBytes(capacity);
+  r.instanceBytes = (size_t)capacity * sizeof(glm::vec3);
+  r.gridBytes = NeighborGrid::EstimateBytes(EstimateCellCount(), capacity);
+  r.scratchBytes = ScratchBytes(capacity);
+  r.boundaryBytes = boundaryPos_.size() * (sizeof(glm::vec2) + sizeof(float)) +
+                    boundaryGrid_.GetBytes();
+  r.gpuBytes =
+      (size_t)capacity * sizeof(glm::vec3) + ParticleRenderer::MeshBytes();
+  return r;
+}
+
+void FluidSim::GenerateInitial(InitShape shape, int count, uint32_t seed,
+                               int relaxIterations) {
+  if (count <= 0)
     return;
-  SpawnParticles(dt);
+  const float spacing = SpacingForDensity(restDensity_);
+
+  InitRequest req;
+  req.shape = shape;
+  req.min = scene_.containerMin + glm::vec2(renderRadius_);
+  req.max = scene_.containerMax - glm::vec2(renderRadius_);
+  req.spacing = spacing;
+  req.maxCount = count;
+  req.seed = seed;
+  if (shape == InitShape::DamBreak) {
+    // Column twice as tall as wide against the left wall.
+    float cols = std::ceil(std::sqrt(count * 0.5f));
+    req.max.x = std::min(req.max.x, req.min.x + cols * spacing);
+    req.max.y = std::min(req.max.y, req.min.y + 2.0f * cols * spacing);
+  }
 
-  const int substeps = 4;
-  const float sdt = std::min(dt, 0.016f) / substeps;
-  for (int s = 0; s < substeps; ++s) {
+  auto inside = [this](glm::vec2 p) {
+    return sdf_.Sample(p).dist >= renderRadius_;
+  };
+  std::vector<glm::vec2> pts = GenerateInitialPositions(req, inside);
+
+  if ((int)pts.size() > capacity_)
+    SetCapacity((int)pts.size());
+  particles_.resize(pts.size());
+  handles_.Clear();
+  handles_.Append((int)pts.size());
+  drained_ = 0;
+  WakeAll();
+  JobSystem::Get().ParallelFor((int)pts.size(), 4096, [&](int b, int e) {
+    for (int i = b; i < e; ++i) {
+      Particle &p = particles_[i];
+      p.pos = pts[i];
+      p.vel = glm::vec2(0.0f);
+      p.force = glm::vec2(0.0f);
+      p.density = 0.0f;
+      p.pressure = 0.0f;
+    }
+  });
+  ResetEmitters();
+
+  Relax(relaxIterations);
+}
+
+void FluidSim::Relax(int iterations) {
+  // Full solver steps with strong velocity damping: the block slumps into
+  // hydrostatic balance without splashing, then starts at rest.
+  const float dt = 0.004f;
+  ResetScratch();
+  asleep_.assign(particles_.size(), 0);
+  rateMask_.assign(particles_.size(), 0);
+  for (int it = 0; it < iterations; ++it) {
+    BuildNeighborGrid();
     ComputeDensityPressure();
     ComputeForces();
-    Integrate(sdt);
-
+    for (auto &p : particles_) {
+      p.vel = (p.vel + dt * p.force / p.density) * 0.9f;
+      p.pos += dt * p.vel;
+    }
     ResolveParticleCollisions();
-
     EnforceBoundaries();
   }
-
-  UpdateInstanceBuffer();
+  for (auto &p : particles_)
+    p.vel = glm::vec2(0.0f);
+  PackInstances();
 }
 
-void FluidSim::ComputeDensityPressure() {
-  for (auto &pi : particles_) {
-    pi.density = 0.0f;
-    for (const auto &pj : particles_) {
-      glm::vec2 r = pi.pos - pj.pos;
-      float r2 = glm::dot(r, r);
-      pi.density += mass_ * Poly6(r2);
+uint64_t FluidSim::ChecksumParticles(std::span<const Particle> particles) {
+  uint64_t h = 1469598103934665603ull;
+  auto mix = [&h](float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof bits);
+    for (int k = 0; k < 4; ++k) {
+      h ^= (bits >> (8 * k)) & 0xffu;
+      h *= 1099511628211ull;
     }
-    pi.density = std::max(pi.density, 0.001f);
-    pi.pressure = gasConstant_ * (pi.density - restDensity_);
+  };
+  for (const auto &p : particles) {
+    mix(p.pos.x);
+    mix(p.pos.y);
+    mix(p.vel.x);
+    mix(p.vel.y);
   }
+  return h;
 }
 
-void FluidSim::ComputeForces() {
+void FluidSim::PackInstances() {
   int n = (int)particles_.size();
-  for (int i = 0; i < n; ++i) {
-    glm::vec2 fp(0.0f), fv(0.0f);
-    for (int j = 0; j < n; ++j) {
-      if (i == j)
-        continue;
-      glm::vec2 r_vec = particles_[i].pos - particles_[j].pos;
-      float r_len = glm::length(r_vec);
-      if (r_len >= h_ || r_len < 1e-6f)
-        continue;
+  instances_.resize(n);
+  for (int i = 0; i < n; ++i)
+    instances_[i] = {particles_[i].pos.x, particles_[i].pos.y,
+                     glm::length(particles_[i].vel)};
+  UpdateInstanceBuffer();
+}
 
-      float avgP = (particles_[i].pressure + particles_[j].pressure) * 0.5f;
-      fp += -mass_ * avgP / particles_[j].density * SpikyGrad(r_vec, r_len);
+void FluidSim::Reset() {
+  particles_.clear();
+  instances_.clear();
+  handles_.Clear();
+  drained_ = 0;
+  WakeAll();
+  ResetEmitters();
+}
 
-      fv += viscosity_ * mass_ * (particles_[j].vel - particles_[i].vel) /
-            particles_[j].density * ViscLaplacian(r_len);
-    }
-    glm::vec2 fg(0.0f, -gravity_ * particles_[i].density);
-    particles_[i].force = fp + fv + fg;
+void FluidSim::ResetEmitters() {
+  emitterState_.assign(scene_.emitters.size(), EmitterState{});
+  for (size_t i = 0; i < emitterState_.size(); ++i)
+    emitterState_[i].rng.seed(scene_.emitters[i].seed);
+}
+
+bool FluidSim::SetPerfCounters(bool on) {
+  perfFrame_ = perfTotal_ = {};
+  if (!on) {
+    perf_.Close();
+    return true;
   }
+  perfThreads_ = JobSystem::Get().GetThreadIdsVersion();
+  return perf_.Open(JobSystem::Get().GetThreadIds());
 }
 
-void FluidSim::Integrate(float dt) {
-  for (auto &p : particles_) {
-    p.vel += dt * p.force / p.density;
-    p.pos += dt * p.vel;
-    p.vel *= 0.9998f;
+void FluidSim::BeginPerfFrame() {
+  // Reopen on the new set of threads after a thread count change.
+  if (perfThreads_ != JobSystem::Get().GetThreadIdsVersion()) {
+    PhaseCounters total = perfTotal_;
+    if (!SetPerfCounters(true))
+      return;
+    perfTotal_ = total;
   }
+  perfFrame_ = {};
+  for (int e = 0; e < PerfEventCount; ++e)
+    if (perf_.HasEvent((PerfEvent)e))
+      perfFrame_.events |= 1u << e;
+  perf_.Lap(); // start the first phase here
 }
 
-void FluidSim::EnforceBoundaries() {
-  for (auto &p : particles_) {
-    if (p.pos.x - renderRadius_ < wallL_) {
-      p.pos.x = wallL_ + renderRadius_;
-      p.vel.x = std::abs(p.vel.x) * restitution_;
-    }
-    if (p.pos.x + renderRadius_ > wallR_) {
-      p.pos.x = wallR_ - renderRadius_;
-      p.vel.x = -std::abs(p.vel.x) * restitution_;
+void FluidSim::AddPerfPhase(SolverPhase phase) {
+  PerfSample lap = perf_.Lap();
+  PerfSample &acc = perfFrame_.phases[(int)phase];
+  for (int e = 0; e < PerfEventCount; ++e)
+    acc.v[e] += lap.v[e];
+}
+
+void FluidSim::EndPerfFrame() {
+  perfFrame_.particles = particles_.size();
+  perfFrame_.steps = 1;
+  perfTotal_.Add(perfFrame_);
+  perfTotal_.events = perfFrame_.events;
+}
+
+void FluidSim::Update(float dt) {
+  if (!running_)
+    return;
+  const int substeps = 4;
+  const float sdt = std::min(dt, 0.016f) / substeps;
+  sdt_ = sdt;
+  frameTime_ = sdt * substeps;
+  if (perf_.IsOpen())
+    BeginPerfFrame();
+#ifndef NDEBUG
+  // Only a new grid layout or arena growth may touch the heap in a step.
+  HeapCountScope heap;
+  bool steady = gridReady_ && grid_.GetCellSize() == GridCellSize();
+  int arenaBlocks = arena_.GetBlockAllocations();
+#endif
+  ResetScratch();
+
+  DrainSinks();
+  ClassifyParticles();
+  size_t before = particles_.size();
+  SpawnParticles(dt);
+  // New particles start awake at the finest level.
+  asleep_.resize(particles_.size(), 0);
+  rateMask_.resize(particles_.size(), 0);
+  levelCount_[0] += (int)(particles_.size() - before);
+  PerfMark(SolverPhase::Emit);
+
+  for (int s = 0; s < substeps; ++s) {
+    substep_ = s + 1;
+    BuildNeighborGrid();
+    PerfMark(SolverPhase::Grid);
+    ComputeDensityPressure();
+    PerfMark(SolverPhase::Density);
+    ComputeForces();
+    PerfMark(SolverPhase::Forces);
+    if (s + 1 < substeps) {
+      Integrate(sdt);
+      PerfMark(SolverPhase::Integrate);
+
+      ResolveParticleCollisions();
+      PerfMark(SolverPhase::Collisions);
+
+      EnforceBoundaries();
+      PerfMark(SolverPhase::Boundaries);
+    } else {
+      // Last substep: resolve contacts first so integration, clamping, the
+      // max-speed reduction and the instance write share one pass.
+      ResolveParticleCollisions();
+      PerfMark(SolverPhase::Collisions);
+      IntegrateAndPack(sdt);
+      PerfMark(SolverPhase::Integrate);
     }
-    if (p.pos.y - renderRadius_ < wallB_) {
-      p.pos.y = wallB_ + renderRadius_;
-      p.vel.y = std::abs(p.vel.y) * restitution_;
+  }
+  UpdateCellState();
+  PerfMark(SolverPhase::Cells);
+  if (perf_.IsOpen())
+    EndPerfFrame();
+#ifndef NDEBUG
+  steady = steady && arena_.GetBlockAllocations() == arenaBlocks;
+  assert(!steady || heap.GetCount() == 0);
+#endif
+
+  // The driver may allocate here, so this stays out of the check above.
+  AllocTagScope upload(AllocTag::Upload);
+  UpdateInstanceBuffer();
+}
+
+void FluidSim::IntegrateAndPack(float dt) {
+  int n = (int)particles_.size();
+  instances_.resize(n);
+  // One max per fixed chunk, combined afterwards in chunk order.
+  chunkMaxSpeed_ = arena_.Alloc<float>((n + packGrain_ - 1) / packGrain_);
+  (this->*passes_.integrateAndPack)(dt);
+  float maxSpeed = 0.1f;
+  for (float m : chunkMaxSpeed_)
+    maxSpeed = std::max(maxSpeed, m);
+  maxSpeed_ = maxSpeed;
+}
+
+void FluidSim::ClassifyParticles() {
+  int n = (int)particles_.size();
+  asleep_.assign(n, 0);
+  rateMask_.assign(n, 0);
+  sleepingCount_ = 0;
+  std::fill(std::begin(levelCount_), std::end(levelCount_), 0);
+  if (cellState_.empty()) {
+    levelCount_[0] = n;
+    return;
+  }
+  // Skip the per-particle limits when even a resting particle is held to
+  // level 0 by the sound speed.
+  bool rates = multiRate_ && RateLevel(0.0f, 0.0f) > 0;
+  for (int i = 0; i < n; ++i) {
+    Particle &p = particles_[i];
+    const CellState &cs = cellState_[grid_.CellOf(p.pos)];
+    if (sleeping_ && cs.sleeping) {
+      asleep_[i] = 1;
+      p.vel = glm::vec2(0.0f);
+      ++sleepingCount_;
+      continue;
     }
-    if (p.pos.y + renderRadius_ > wallT_) {
-      p.pos.y = wallT_ - renderRadius_;
-      p.vel.y = -std::abs(p.vel.y) * restitution_;
+    // The particle's own limits catch fast particles entering a quiet cell.
+    int level = 0;
+    if (rates) {
+      float accel = glm::length(p.force) / p.density;
+      level = std::min<int>(cs.level, RateLevel(glm::length(p.vel), accel));
     }
-    ResolveObstacle(p);
+    rateMask_[i] = (uint8_t)((1 << level) - 1);
+    ++levelCount_[level];
   }
 }
 
-glm::vec2 FluidSim::ClosestOnSegment(glm::vec2 p, glm::vec2 a,
-                                     glm::vec2 b) const {
-  glm::vec2 ab = b - a;
-  float t = glm::clamp(glm::dot(p - a, ab) / glm::dot(ab, ab), 0.0f, 1.0f);
-  return a + t * ab;
-}
-
-void FluidSim::ResolveObstacle(Particle &p) {
-  glm::vec2 edges[3][2] = {
-      {obstA_, obstB_}, {obstB_, obstC_}, {obstC_, obstA_}};
-  for (auto &edge : edges) {
-    glm::vec2 closest = ClosestOnSegment(p.pos, edge[0], edge[1]);
-    glm::vec2 diff = p.pos - closest;
-    float dist = glm::length(diff);
-    if (dist < renderRadius_ * 1.5f && dist > 1e-6f) {
-      glm::vec2 n = diff / dist;
-      p.pos = closest + n * (renderRadius_ * 1.5f);
-      float vn = glm::dot(p.vel, n);
-      if (vn < 0.0f)
-        p.vel -= (1.0f + restitution_) * vn * n;
+int FluidSim::RateLevel(float speed, float accel) const {
+  // p = k (rho - rho0) carries sound at c = sqrt(k); the acoustic limit is
+  // what bounds the step inside the fluid, not the flow speed.
+  float c = std::sqrt(gasConstant_);
+  float dtMax = cflSpeed_ * h_ / (c + speed);
+  if (accel > 0.0f)
+    dtMax = std::min(dtMax, cflAccel_ * std::sqrt(h_ / accel));
+  int level = 0;
+  while (level < maxRateLevel_ && sdt_ * (2 << level) <= dtMax)
+    ++level;
+  return level;
+}
+
+void FluidSim::UpdateCellState() {
+  if (!sleeping_ && !multiRate_)
+    return;
+  int cells = grid_.GetCellCount();
+  if ((int)cellState_.size() != cells)
+    cellState_.assign(cells, CellState{});
+  cellSamples_ = arena_.Alloc<CellSample>(cells);
+  for (const auto &p : particles_) {
+    CellSample &s = cellSamples_[grid_.CellOf(p.pos)];
+    ++s.count;
+    s.densitySum += p.density;
+    s.maxSpeed = std::max(s.maxSpeed, glm::length(p.vel));
+    s.maxAccel = std::max(s.maxAccel, glm::length(p.force) / p.density);
+  }
+
+  for (int c = 0; c < cells; ++c) {
+    CellState &cs = cellState_[c];
+    CellSample &s = cellSamples_[c];
+    float rho = s.count ? s.densitySum / s.count : 0.0f;
+    bool calm = s.count == 0 ||
+                (s.maxSpeed < sleepSpeed_ && s.count == cs.count &&
+                 std::abs(rho - cs.density) <= sleepDensityChange_ * rho);
+    cs.calmFrames = calm ? std::min(cs.calmFrames + 1, sleepFrames_) : 0;
+    cs.count = s.count;
+    cs.density = rho;
+    // Empty cells place no limit on their neighbours.
+    s.level = s.count ? RateLevel(s.maxSpeed, s.maxAccel) : maxRateLevel_;
+  }
+
+  // Both decisions look at the 3x3 block. A cell sleeps only inside a calm
+  // block, so activity next door wakes it a frame before anything can reach
+  // its particles; it runs at the finest level of the block, so particles
+  // that can interact are never more than one cell's limits apart.
+  int nx = grid_.GetCellsX(), ny = grid_.GetCellsY();
+  for (int cy = 0; cy < ny; ++cy) {
+    for (int cx = 0; cx < nx; ++cx) {
+      CellState &cs = cellState_[cy * nx + cx];
+      bool sleep = cs.count > 0;
+      int level = maxRateLevel_;
+      for (int y = cy - 1; y <= cy + 1; ++y) {
+        for (int x = cx - 1; x <= cx + 1; ++x) {
+          if (x < 0 || y < 0 || x >= nx || y >= ny)
+            continue;
+          int nb = y * nx + x;
+          if (cellState_[nb].calmFrames < sleepFrames_)
+            sleep = false;
+          level = std::min(level, cellSamples_[nb].level);
+        }
+      }
+      cs.sleeping = sleep;
+      cs.level = (uint8_t)level;
     }
   }
 }
 
 void FluidSim::ResolveParticleCollisions() {
+  if (collisionMode_ == CollisionMode::Jacobi) {
+    ResolveParticleCollisionsJacobi();
+    return;
+  }
   int n = (int)particles_.size();
+  float minDist = 2.0f * particleRadius_;
 
   for (int i = 0; i < n; ++i) {
-    for (int j = i + 1; j < n; ++j) {
+    if (!Kicked(i))
+      continue;
+    grid_.ForEachNeighbor(particles_[i].pos, [&](int j) {
+      // Pairs need one kicked particle. Two kicked ones are visited once
+      // (j > i); drifting and sleeping j from the kicked side only.
+      bool staticJ = asleep_[j];
+      if (j == i || (Kicked(j) && j < i))
+        return;
 
       glm::vec2 r = particles_[i].pos - particles_[j].pos;
       float dist = glm::length(r);
-      float minDist = 2.0f * particleRadius_;
 
       if (dist < minDist && dist > 1e-6f) {
         glm::vec2 normal = r / dist;
         float penetration = minDist - dist;
+        float vi = glm::dot(particles_[i].vel, normal);
+
+        if (staticJ) {
+          // Sleeping particles do not move: i takes the whole correction.
+          particles_[i].pos += penetration * normal;
+          particles_[i].vel -= vi * normal;
+          return;
+        }
 
         particles_[i].pos += 0.5f * penetration * normal;
         particles_[j].pos -= 0.5f * penetration * normal;
 
-        float vi = glm::dot(particles_[i].vel, normal);
         float vj = glm::dot(particles_[j].vel, normal);
 
         float impulse = (vi - vj) * 0.5f;
@@ -189,117 +648,117 @@ void FluidSim::ResolveParticleCollisions() {
         particles_[i].vel -= impulse * normal;
         particles_[j].vel += impulse * normal;
       }
-    }
+    });
   }
 }
 
 void FluidSim::SpawnParticles(float dt) {
-  if ((int)particles_.size() >= maxParticles_)
-    return;
-  spawnTimer_ += dt;
-  if (spawnTimer_ < spawnInterval_)
+  // Pass 1 (serial, cheap): advance the clocks and hand each firing emitter
+  // a slice of one batch. Later emitters go short when capacity runs out.
+  int room = std::max(0, capacity_ - (int)particles_.size());
+  int total = 0;
+  for (size_t i = 0; i < emitterState_.size(); ++i) {
+    EmitterState &st = emitterState_[i];
+    const SceneEmitter &em = scene_.emitters[i];
+    st.first = total;
+    st.count = 0;
+    st.timer += dt;
+    if (st.timer < em.interval)
+      continue;
+    st.timer = 0.0f;
+    st.count = std::min(em.burst * quality_, room - total);
+    total += st.count;
+  }
+  if (total == 0)
     return;
-  spawnTimer_ = 0.0f;
 
-  static std::mt19937 rng(42);
-  std::uniform_real_distribution<float> distX(-0.06f, 0.06f);
-  std::uniform_real_distribution<float> distVX(-0.15f, 0.15f);
+  // Pass 2: grow once and let every emitter fill its slice from its own RNG
+  // stream, so the result does not depend on how the emitters are split.
+  size_t base = particles_.size();
+  particles_.resize(base + total);
+  handles_.Append(total);
+  Particle *batch = particles_.data() + base;
+  int emitters = (int)emitterState_.size();
+  JobSystem::Get().ParallelFor(emitters, 64, [&](int b, int e) {
+    for (int i = b; i < e; ++i)
+      EmitBatch(i, batch);
+  });
+}
 
-  int toSpawn = std::min(quality_, maxParticles_ - (int)particles_.size());
-  for (int i = 0; i < toSpawn; ++i) {
-    Particle np;
-    np.pos = {distX(rng), 0.72f};
-    np.vel = {distVX(rng), -0.4f};
-    np.force = glm::vec2(0.0f);
-    particles_.push_back(np);
+void FluidSim::DrainSinks() {
+  if (scene_.sinks.empty())
+    return;
+  // Swap-remove keeps particles_ dense. Walking backwards means the particle
+  // moved into slot i has already been tested.
+  for (int i = (int)particles_.size() - 1; i >= 0; --i) {
+    glm::vec2 p = particles_[i].pos;
+    for (const auto &sink : scene_.sinks) {
+      if (p.x < sink.min.x || p.x > sink.max.x || p.y < sink.min.y ||
+          p.y > sink.max.y)
+        continue;
+      particles_[i] = particles_.back();
+      particles_.pop_back();
+      handles_.SwapRemove(i);
+      ++drained_;
+      break;
+    }
   }
 }
 
-void FluidSim::InitParticleGL() {
-  const int segs = 14;
-  circleVerts_ = segs + 2;
-
-  std::vector<glm::vec2> circle;
-  circle.reserve(circleVerts_);
-  circle.push_back({0.0f, 0.0f});
-  for (int i = 0; i <= segs; ++i) {
-    float theta = 2.0f * (float)M_PI * i / segs;
-    circle.push_back({std::cos(theta), std::sin(theta)});
+void FluidSim::EmitBatch(int index, Particle *batch) {
+  EmitterState &st = emitterState_[index];
+  if (st.count == 0)
+    return;
+  const SceneEmitter &em = scene_.emitters[index];
+
+  // Spawn just outside the face along dir, across its middle two thirds.
+  glm::vec2 c = (em.min + em.max) * 0.5f;
+  glm::vec2 ext = (em.max - em.min) * 0.5f;
+  glm::vec2 side(-em.dir.y, em.dir.x);
+  glm::vec2 a = glm::abs(em.dir), t = glm::abs(side);
+  glm::vec2 origin = c + em.dir * (a.x * ext.x + a.y * ext.y + 0.06f);
+  float half = (t.x * ext.x + t.y * ext.y) * (2.0f / 3.0f);
+  std::uniform_real_distribution<float> across(-half, half);
+  std::uniform_real_distribution<float> jitter(-em.jitter, em.jitter);
+
+  Particle *out = batch + st.first;
+  for (int k = 0; k < st.count; ++k) {
+    Particle &np = out[k];
+    np.pos = origin + side * across(st.rng);
+    np.vel = em.dir * em.speed + side * jitter(st.rng);
+    np.force = glm::vec2(0.0f);
+    np.density = 0.0f;
+    np.pressure = 0.0f;
   }
+}
 
-  glGenVertexArrays(1, &particleVAO_);
-  glBindVertexArray(particleVAO_);
-
-  glGenBuffers(1, &circleVBO_);
-  glBindBuffer(GL_ARRAY_BUFFER, circleVBO_);
-  glBufferData(GL_ARRAY_BUFFER, circle.size() * sizeof(glm::vec2),
-               circle.data(), GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
-  glEnableVertexAttribArray(0);
-  glVertexAttribDivisor(0, 0);
-
-  glGenBuffers(1, &instanceVBO_);
-  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO_);
-  glBufferData(GL_ARRAY_BUFFER, maxParticles_ * sizeof(glm::vec3), nullptr,
-               GL_DYNAMIC_DRAW);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-  glEnableVertexAttribArray(1);
-  glVertexAttribDivisor(1, 1);
-
-  glBindVertexArray(0);
+void FluidSim::InitParticleGL() {
+  if (!graphics_)
+    return;
+  renderer_ = std::make_unique<ParticleRenderer>(capacity_);
 }
 
 void FluidSim::UpdateInstanceBuffer() {
-  int n = (int)particles_.size();
-  if (n == 0)
+  int n = (int)instances_.size();
+  if (n == 0 || !renderer_)
     return;
-
-  float maxSpeed = 0.1f;
-  for (const auto &p : particles_) {
-    float s = glm::length(p.vel);
-    if (s > maxSpeed)
-      maxSpeed = s;
-  }
-
-  std::vector<glm::vec3> inst(n);
-  for (int i = 0; i < n; ++i) {
-    float speed01 =
-        glm::clamp(glm::length(particles_[i].vel) / maxSpeed, 0.0f, 1.0f);
-    inst[i] = {particles_[i].pos.x, particles_[i].pos.y, speed01};
-  }
-
-  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO_);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(glm::vec3), inst.data());
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  renderer_->Upload(instances_.data(), n);
 }
 
-void FluidSim::RenderParticles(GLuint program, GLint uRadius, GLint uColorLow,
-                               GLint uColorHigh) {
+void FluidSim::RenderParticles(GLuint program, const ParticleUniforms &u) {
   int n = (int)particles_.size();
-  if (n == 0)
+  if (n == 0 || !renderer_)
     return;
 
-  glUseProgram(program);
-  if (uRadius >= 0)
-    glUniform1f(uRadius, renderRadius_);
-  if (uColorLow >= 0)
-    glUniform3fv(uColorLow, 1, &baseColor_[0]);
-  glm::vec3 highColor =
-      glm::mix(baseColor_, glm::vec3(1.0f, 0.95f, 0.85f), 0.85f);
-  if (uColorHigh >= 0)
-    glUniform3fv(uColorHigh, 1, &highColor[0]);
-
-  glBindVertexArray(particleVAO_);
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, circleVerts_, n);
-  glDisable(GL_BLEND);
-  glBindVertexArray(0);
-  glUseProgram(0);
+  renderer_->Draw(program, u, renderRadius_, baseColor_, GetHighColor(),
+                  maxSpeed_, std::min(n, (int)instances_.size()));
 }
 
 void FluidSim::InitSceneGL() {
-  const float il = wallL_, ir = wallR_, ib = wallB_, it = wallT_;
+  if (!graphics_)
+    return;
+  const float il = scene_.containerMin.x, ir = scene_.containerMax.x;
+  const float ib = scene_.containerMin.y, it = scene_.containerMax.y;
   const float tw = 0.05f; // wall thickness
 
   auto pushQuad = [](std::vector<float> &v, float x0, float y0, float x1,
@@ -308,17 +767,46 @@ void FluidSim::InitSceneGL() {
   };
 
   std::vector<float> verts;
-  verts.reserve((24 + 3 + 6) * 2);
+  verts.reserve(
+      (24 + 6 * (scene_.emitters.size() + scene_.sinks.size())) * 2);
 
   pushQuad(verts, il - tw, ib - tw, il, it + tw);
   pushQuad(verts, ir, ib - tw, ir + tw, it + tw);
   pushQuad(verts, il - tw, ib - tw, ir + tw, ib);
   pushQuad(verts, il - tw, it, ir + tw, it + tw);
 
-  verts.insert(verts.end(),
-               {obstA_.x, obstA_.y, obstB_.x, obstB_.y, obstC_.x, obstC_.y});
+  // obstacles: ear-clipped polygons and one quad per polyline segment
+  std::vector<glm::vec2> tris;
+  for (const auto &poly : scene_.polygons)
+    TriangulatePolygon(poly, tris);
+  for (const auto &line : scene_.polylines) {
+    float hw = line.thickness * 0.5f;
+    for (size_t i = 1; i < line.pts.size(); ++i) {
+      glm::vec2 a = line.pts[i - 1], b = line.pts[i];
+      glm::vec2 d = b - a;
+      float len = glm::length(d);
+      if (len < 1e-7f)
+        continue;
+      glm::vec2 n = glm::vec2(-d.y, d.x) * (hw / len);
+      tris.insert(tris.end(), {a - n, b - n, b + n, a - n, b + n, a + n});
+    }
+  }
+  for (auto v : tris)
+    verts.insert(verts.end(), {v.x, v.y});
+  obstacleVerts_ = (int)tris.size();
+  emitterFirst_ = 24 + obstacleVerts_;
+  for (const auto &em : scene_.emitters)
+    pushQuad(verts, em.min.x, em.min.y, em.max.x, em.max.y);
+  emitterVerts_ = 6 * (int)scene_.emitters.size();
+  sinkFirst_ = emitterFirst_ + emitterVerts_;
+  for (const auto &sink : scene_.sinks)
+    pushQuad(verts, sink.min.x, sink.min.y, sink.max.x, sink.max.y);
+  sinkVerts_ = 6 * (int)scene_.sinks.size();
 
-  pushQuad(verts, -0.09f, 0.78f, 0.09f, 0.88f);
+  if (sceneVAO_)
+    glDeleteVertexArrays(1, &sceneVAO_);
+  if (sceneVBO_)
+    glDeleteBuffers(1, &sceneVBO_);
 
   glGenVertexArrays(1, &sceneVAO_);
   glBindVertexArray(sceneVAO_);
@@ -335,6 +823,8 @@ void FluidSim::InitSceneGL() {
 }
 
 void FluidSim::RenderScene(GLuint program, GLint uColor) {
+  if (!sceneVAO_)
+    return;
   glUseProgram(program);
   glBindVertexArray(sceneVAO_);
 
@@ -344,15 +834,78 @@ void FluidSim::RenderScene(GLuint program, GLint uColor) {
 
   if (uColor >= 0)
     glUniform4f(uColor, 0.42f, 0.45f, 0.52f, 1.0f);
-  glDrawArrays(GL_TRIANGLES, 24, 3);
+  if (obstacleVerts_ > 0)
+    glDrawArrays(GL_TRIANGLES, 24, obstacleVerts_);
 
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   if (uColor >= 0)
     glUniform4f(uColor, 0.10f, 0.85f, 0.75f, 0.55f);
-  glDrawArrays(GL_TRIANGLES, 27, 6);
+  if (emitterVerts_ > 0)
+    glDrawArrays(GL_TRIANGLES, emitterFirst_, emitterVerts_);
+  if (uColor >= 0)
+    glUniform4f(uColor, 0.85f, 0.30f, 0.25f, 0.45f);
+  if (sinkVerts_ > 0)
+    glDrawArrays(GL_TRIANGLES, sinkFirst_, sinkVerts_);
   glDisable(GL_BLEND);
 
   glBindVertexArray(0);
   glUseProgram(0);
-}
\ No newline at end of file
+}
+
+void FluidSim::ResolveParticleCollisionsJacobi() {
+  int n = (int)particles_.size();
+  float minDist = 2.0f * particleRadius_;
+  if ((int)collisionDelta_.size() != n)
+    collisionDelta_ = arena_.Alloc<CollisionDelta>(n);
+
+  // Gather: each particle sums the corrections its contacts ask of it from
+  // the positions and velocities at the start of the pass. Only its own
+  // delta is written, so chunks need no locks and the neighbour order fixes
+  // the summation order.
+  JobSystem::Get().ParallelFor(n, 256, [&](int b, int e) {
+    for (int i = b; i < e; ++i) {
+      CollisionDelta d;
+      if (!asleep_[i]) {
+        const Particle &pi = particles_[i];
+        bool kickedI = Kicked(i);
+        grid_.ForEachNeighbor(pi.pos, [&](int j) {
+          if (j == i || !(kickedI || Kicked(j)))
+            return;
+          const Particle &pj = particles_[j];
+          glm::vec2 r = pi.pos - pj.pos;
+          float dist = glm::length(r);
+          if (dist >= minDist || dist <= 1e-6f)
+            return;
+          glm::vec2 normal = r / dist;
+          float penetration = minDist - dist;
+          float vi = glm::dot(pi.vel, normal);
+          if (asleep_[j]) {
+            d.pos += penetration * normal;
+            d.vel -= vi * normal;
+          } else {
+            float vj = glm::dot(pj.vel, normal);
+            d.pos += 0.5f * penetration * normal;
+            d.vel -= 0.5f * (vi - vj) * normal;
+          }
+          ++d.contacts;
+        });
+      }
+      collisionDelta_[i] = d;
+    }
+  });
+
+  // Apply, averaged over the contacts (Macklin et al. 2014) so crowded
+  // particles do not overshoot. Over-relaxing (omega 1.5) or a fixed half
+  // step both let the pool gain energy.
+  JobSystem::Get().ParallelFor(n, 1024, [&](int b, int e) {
+    for (int i = b; i < e; ++i) {
+      const CollisionDelta &d = collisionDelta_[i];
+      if (d.contacts == 0)
+        continue;
+      float w = jacobiOmega_ / d.contacts;
+      particles_[i].pos += w * d.pos;
+      particles_[i].vel += w * d.vel;
+    }
+  });
+}
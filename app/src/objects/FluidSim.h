@@ -1,8 +1,47 @@
 #pragma once
+#include "CpuFeatures.h"
+#include "InitialConditions.h"
+#include "NeighborGrid.h"
+#include "ParticleHandles.h"
+#include "ParticleRenderer.h"
+#include "PerfCounters.h"
+#include "Scene.h"
+#include "ScratchArena.h"
+#include "SdfGrid.h"
+#include <algorithm>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
 #include <vector>
 
+enum class BoundaryMode { Sdf = 0, Exact = 1 };
+// Particle contacts: in-place sequential sweep, or per-particle delta
+// buffers gathered in parallel and applied in a second pass.
+enum class CollisionMode { GaussSeidel = 0, Jacobi = 1 };
+// Smoothing kernel family (see SphKernels.h).
+enum class KernelFamily { Muller = 0, Wendland = 1, CubicSpline = 2 };
+// Accumulator type for the density and force sums.
+enum class Precision { Float = 0, Double = 1 };
+
+struct MemoryReport {
+  int capacity = 0;
+  size_t particleBytes = 0; // particle array and handle table
+  size_t instanceBytes = 0; // CPU-side instance staging
+  size_t gridBytes = 0;     // neighbour grid cells and index arrays
+  size_t boundaryBytes = 0; // static boundary samples and their grid
+  size_t scratchBytes = 0;  // per-step arena
+  size_t gpuBytes = 0;      // instance VBO and impostor mesh
+
+  size_t CpuTotal() const {
+    return particleBytes + instanceBytes + gridBytes + boundaryBytes +
+           scratchBytes;
+  }
+  size_t Total() const { return CpuTotal() + gpuBytes; }
+};
+
 struct Particle {
   glm::vec2 pos;
   glm::vec2 vel;
@@ -13,34 +52,170 @@ struct Particle {
 
 class FluidSim {
 public:
-  FluidSim();
+  // graphics = false skips every GL object so the solver can run headless.
+  explicit FluidSim(bool graphics = true);
   ~FluidSim();
 
   void Update(float dt);
-  void RenderParticles(GLuint program, GLint uRadius, GLint uColorLow,
-                       GLint uColorHigh);
+  void RenderParticles(GLuint program, const ParticleUniforms &u);
   void RenderScene(GLuint program, GLint uColor);
 
-  void SetGravity(float g) { gravity_ = g; }
-  void SetViscosity(float v) { viscosity_ = glm::clamp(v, 0.0f, 10.0f); }
-  void SetQuality(int q) { quality_ = glm::clamp(q, 1, 10); }
-  void SetRenderRadius(float r) {
-    renderRadius_ = r;
-    particleRadius_ = r;
+  void SetGravity(float g) {
+    gravity_ = g;
+    WakeAll();
+  }
+  void SetViscosity(float v) {
+    viscosity_ = glm::clamp(v, 0.0f, 10.0f);
+    WakeAll();
   }
+  // Pressure stiffness k in p = k (rho - rho0). Softer fluids compress
+  // more but allow longer steps (see the multi-rate levels).
+  void SetGasConstant(float k) {
+    gasConstant_ = glm::clamp(k, 1.0f, 200.0f);
+    WakeAll();
+  }
+  float GetGasConstant() const { return gasConstant_; }
+  void SetQuality(int q) { quality_ = glm::clamp(q, 1, 10); }
+  int GetQuality() const { return quality_; }
+  void SetRenderRadius(float r);
+  float GetRenderRadius() const { return renderRadius_; }
   void SetBaseColor(glm::vec3 c) { baseColor_ = c; }
+  glm::vec3 GetBaseColor() const { return baseColor_; }
+  // Colour of the fastest particles, a tint of the base colour.
+  glm::vec3 GetHighColor() const {
+    return glm::mix(baseColor_, glm::vec3(1.0f, 0.95f, 0.85f), 0.85f);
+  }
+  void SetRenderMode(ParticleRenderMode m) {
+    if (renderer_)
+      renderer_->SetMode(m);
+  }
   void SetRunning(bool r) { running_ = r; }
+  bool GetRunning() const { return running_; }
   void Reset();
 
+  // Solid polygons inside the container; the SDF and scene mesh are rebaked.
+  void AddObstacle(const std::vector<glm::vec2> &polygon);
+  void ClearObstacles();
+  void LoadScene(const Scene &scene);
+  const Scene &GetScene() const { return scene_; }
+  void SetBoundaryMode(BoundaryMode m) {
+    boundaryMode_ = m;
+    SelectPasses();
+  }
+  BoundaryMode GetBoundaryMode() const { return boundaryMode_; }
+  // Rebuilds the boundary volumes and rest density for the new kernel.
+  void SetKernel(KernelFamily k);
+  KernelFamily GetKernel() const { return kernel_; }
+  void SetPrecision(Precision p) {
+    precision_ = p;
+    SelectPasses();
+  }
+  Precision GetPrecision() const { return precision_; }
+  // Instruction set of the hot passes; defaults to DetectCpuIsa() and is
+  // clamped to it.
+  void SetIsa(CpuIsa isa);
+  CpuIsa GetIsa() const { return isa_; }
+  void SetCollisionMode(CollisionMode m) { collisionMode_ = m; }
+  CollisionMode GetCollisionMode() const { return collisionMode_; }
+  void SetBoundaryParticles(bool on) { boundaryParticles_ = on; }
+  bool GetBoundaryParticles() const { return boundaryParticles_; }
+  int GetBoundaryParticleCount() const { return (int)boundaryPos_.size(); }
+  int GetEmitterCount() const { return (int)scene_.emitters.size(); }
+  // Settled grid cells stop being simulated until a neighbour cell stirs.
+  void SetSleeping(bool on) {
+    sleeping_ = on;
+    WakeAll();
+  }
+  bool GetSleeping() const { return sleeping_; }
+  int GetSleepingCount() const { return sleepingCount_; }
+  void WakeAll() { cellState_.clear(); }
+
+  // Slow cells advance with 2x or 4x the substep between force passes.
+  void SetMultiRate(bool on) {
+    multiRate_ = on;
+    WakeAll();
+  }
+  bool GetMultiRate() const { return multiRate_; }
+  // Awake particles per rate level (1, 2 and 4 substeps per kick).
+  int GetLevelCount(int level) const { return levelCount_[level]; }
+
+  // Hardware counters per Update phase, off by default. Returns false, with
+  // the reason in GetPerfError(), where the counters cannot be opened.
+  bool SetPerfCounters(bool on);
+  bool GetPerfCounters() const { return perf_.IsOpen(); }
+  const std::string &GetPerfError() const { return perf_.GetError(); }
+  // Counts of the last Update, and summed since the counters were enabled.
+  const PhaseCounters &GetPerfFrame() const { return perfFrame_; }
+  const PhaseCounters &GetPerfTotal() const { return perfTotal_; }
+
+  // Particles removed by sinks since the last Reset().
+  int GetDrainedCount() const { return drained_; }
+
+  // Stable identity for particles_[slot]; survives sink removals.
+  ParticleHandle GetParticleHandle(int slot) const {
+    return handles_.Get(slot);
+  }
+  // Current slot of a handle, or -1 once the particle is gone.
+  int FindParticle(ParticleHandle h) const { return handles_.Find(h); }
+
+  // Changing capacity keeps the first `capacity` particles. Clamped to
+  // 1 .. maxCapacity.
+  static constexpr int maxCapacity = 10000000;
+  void SetCapacity(int capacity);
+  int GetCapacity() const { return capacity_; }
+  // Current allocations, or a projection for another capacity.
+  MemoryReport GetMemoryReport() const;
+  MemoryReport EstimateMemory(int capacity) const;
+
+  // Replaces the particles with a bulk-generated block (raising capacity if
+  // needed) spaced for restDensity_, then settles it with damped steps.
+  void GenerateInitial(InitShape shape, int count, uint32_t seed = 1,
+                       int relaxIterations = 240);
+  void Relax(int iterations);
+
   int GetParticleCount() const { return (int)particles_.size(); }
+  // Render data of the last Update per slot: x, y and speed.
+  std::span<const glm::vec3> GetInstances() const { return instances_; }
+  // Simulated seconds the last Update advanced.
+  float GetFrameTime() const { return frameTime_; }
   float GetViscosity() const { return viscosity_; }
   float GetGravity() const { return gravity_; }
+  ParticleRenderMode GetRenderMode() const {
+    return renderer_ ? renderer_->GetMode() : ParticleRenderMode::Quad;
+  }
+  // FNV-1a over the bits of every position and velocity in slot order.
+  // Equal checksums mean bit-identical particle state.
+  uint64_t GetStateChecksum() const { return ChecksumParticles(particles_); }
+
+  // Versioned binary snapshot of the whole solver state: parameters, the
+  // scene, particles and handles, emitter clocks and RNG streams, and the
+  // sleep / rate cell state, so a loaded run continues bit-identically
+  // (FluidSimCheckpoint.cpp). Both print the reason and return false on
+  // failure; a file that fails to load leaves the state untouched.
+  bool SaveCheckpoint(const std::string &path) const;
+  bool LoadCheckpoint(const std::string &path);
 
 private:
+  static uint64_t ChecksumParticles(std::span<const Particle> particles);
+
   std::vector<Particle> particles_;
+  std::vector<glm::vec3> instances_; // x, y, raw speed
+  ParticleHandles handles_;          // mirrors every resize of particles_
+  int drained_ = 0;
+  float maxSpeed_ = 0.1f;
 
   float particleRadius_ = 0.022f;
+  CollisionMode collisionMode_ = CollisionMode::GaussSeidel;
+  // Jacobi contact corrections for one particle, summed over its contacts.
+  struct CollisionDelta {
+    glm::vec2 pos = {0.0f, 0.0f};
+    glm::vec2 vel = {0.0f, 0.0f};
+    int contacts = 0;
+  };
+  std::span<CollisionDelta> collisionDelta_; // scratch
+  static constexpr float jacobiOmega_ = 1.0f;
   void ResolveParticleCollisions();
+  void ResolveParticleCollisionsJacobi();
 
   // ---- SPH parameters ----
   float h_ = 0.055f;
@@ -53,41 +228,180 @@ private:
   float renderRadius_ = 0.022f;
   glm::vec3 baseColor_ = {0.15f, 0.55f, 1.0f};
 
+  bool graphics_ = true;
   bool running_ = true;
   int quality_ = 1;
-  float spawnTimer_ = 0.0f;
-  static constexpr float spawnInterval_ = 0.3f;
-  static constexpr int maxParticles_ = 550;
-
-  static constexpr float wallL_ = -0.85f;
-  static constexpr float wallR_ = 0.85f;
-  static constexpr float wallB_ = -0.85f;
-  static constexpr float wallT_ = 0.85f;
+  // Runtime state per scene_.emitters entry; first/count is the slice of
+  // the current spawn batch.
+  struct EmitterState {
+    float timer = 0.0f;
+    int first = 0;
+    int count = 0;
+    std::minstd_rand rng;
+  };
+  std::vector<EmitterState> emitterState_;
+  int capacity_ = 550;
+
   static constexpr float restitution_ = 0.2f;
 
-  glm::vec2 obstA_ = {-0.28f, -0.85f};
-  glm::vec2 obstB_ = {0.28f, -0.85f};
-  glm::vec2 obstC_ = {0.00f, -0.46f};
+  Scene scene_ = Scene::Default();
+  SdfGrid sdf_;
+  BoundaryMode boundaryMode_ = BoundaryMode::Sdf;
 
-  GLuint particleVAO_ = 0;
-  GLuint circleVBO_ = 0;
-  GLuint instanceVBO_ = 0;
-  int circleVerts_ = 0;
+  NeighborGrid grid_;
+  bool gridReady_ = false;
+
+  // Per grid_ cell state, refreshed at the end of every frame and applied
+  // to the particles at the start of the next.
+  //
+  // Rest: a cell is calm for a frame when every particle in it is slower
+  // than sleepSpeed_ and its particle count and mean density held steady;
+  // it sleeps once it and its eight neighbours have been calm for
+  // sleepFrames_. Sleeping particles are frozen: no density, force or
+  // integration work, and they act as static obstacles in collisions.
+  //
+  // Multi-rate: each cell gets a power-of-two level L from its CFL limits
+  // (lowest level over the 3x3 block). Its particles take one force
+  // evaluation and a 2^L * sdt kick every 2^L substeps and only drift in
+  // between; L <= 2, so every particle is kicked on the last substep.
+  struct CellState {
+    int count = 0;
+    float density = 0.0f; // mean over the cell's particles
+    int calmFrames = 0;
+    bool sleeping = false;
+    uint8_t level = 0;
+  };
+  struct CellSample {
+    int count = 0;
+    float densitySum = 0.0f;
+    float maxSpeed = 0.0f;
+    float maxAccel = 0.0f;
+    int level = 0; // from this cell's own limits
+  };
+  bool sleeping_ = true;
+  static constexpr float sleepSpeed_ = 0.02f;
+  static constexpr float sleepDensityChange_ = 0.002f; // relative, per frame
+  static constexpr int sleepFrames_ = 30;
+  bool multiRate_ = true;
+  static constexpr int maxRateLevel_ = 2;
+  // dt <= cflSpeed_ * h / (c_sound + |v|) and cflAccel_ * sqrt(h / |a|).
+  // With the default gasConstant_ the acoustic limit is already below sdt,
+  // so every particle stays at level 0; softer fluids climb.
+  static constexpr float cflSpeed_ = 0.6f;
+  static constexpr float cflAccel_ = 0.25f;
+  std::vector<CellState> cellState_;
+  std::span<CellSample> cellSamples_; // scratch
+  std::vector<uint8_t> asleep_;    // per particle, fixed for the frame
+  std::vector<uint8_t> rateMask_;  // per particle, 2^level - 1
+  int substep_ = 0;                // 1-based within the frame
+  float sdt_ = 0.0f;
+  float frameTime_ = 0.0f;         // substeps * sdt_
+  int sleepingCount_ = 0;
+  int levelCount_[maxRateLevel_ + 1] = {};
+
+  // Temporaries that live for one step (or one Relax) come from arena_;
+  // the spans pointing into it are dropped by ResetScratch(). Everything
+  // that scales with the particle count is reserved for capacity_ up
+  // front, so a steady-state step makes no heap allocations (checked in
+  // debug builds, see HeapCounter.h).
+  ScratchArena arena_;
+  static constexpr int packGrain_ = 1024; // IntegrateAndPack chunk size
+  std::span<float> chunkMaxSpeed_;        // scratch, one per pack chunk
+  void ResetScratch();
+  size_t ScratchBytes(int capacity) const;
+  float GridCellSize() const { return std::max(h_, 2.0f * particleRadius_); }
+  int EstimateCellCount() const;
+
+  // Counter groups on the caller and every JobSystem worker. PerfMark()
+  // charges everything since the previous mark to the given phase.
+  PerfCounters perf_;
+  unsigned perfThreads_ = 0; // JobSystem::GetThreadIdsVersion() at Open
+  PhaseCounters perfFrame_, perfTotal_;
+  void BeginPerfFrame();
+  void EndPerfFrame();
+  void PerfMark(SolverPhase phase) {
+    if (perf_.IsOpen())
+      AddPerfPhase(phase);
+  }
+  void AddPerfPhase(SolverPhase phase);
+
+  // Particle i takes a force evaluation and a kick on this substep.
+  bool Kicked(int i) const {
+    return !asleep_[i] && (substep_ & rateMask_[i]) == 0;
+  }
+
+  // Static boundary samples (built once per scene) with their volumes;
+  // psi_b = boundaryRho0_ * boundaryVolume_[b].
+  bool boundaryParticles_ = true;
+  std::vector<glm::vec2> boundaryPos_;
+  std::vector<float> boundaryVolume_;
+  float boundaryRho0_ = 0.0f;
+  NeighborGrid boundaryGrid_;
+
+  std::unique_ptr<ParticleRenderer> renderer_;
 
   GLuint sceneVAO_ = 0;
   GLuint sceneVBO_ = 0;
+  int obstacleVerts_ = 0;
+  int emitterFirst_ = 0;
+  int emitterVerts_ = 0;
+  int sinkFirst_ = 0;
+  int sinkVerts_ = 0;
+
+  // The hot passes are templates over the kernel, the accumulator type,
+  // the boundary model and the instruction set. FluidSimPasses*.cpp build
+  // one PassTable per instruction set with every other combination, and
+  // SelectPasses() picks the set for the current settings, so no pair
+  // evaluation branches on them.
+  KernelFamily kernel_ = KernelFamily::Muller;
+  Precision precision_ = Precision::Float;
+  CpuIsa isa_ = DetectCpuIsa();
+  struct SolverPasses {
+    void (FluidSim::*density)();
+    void (FluidSim::*forces)();
+    void (FluidSim::*integrate)(float dt);
+    void (FluidSim::*integrateAndPack)(float dt);
+    void (FluidSim::*enforceBoundaries)();
+  };
+  struct PassTable {
+    void (FluidSim::*density[3][2])();  // [kernel][precision]
+    void (FluidSim::*forces[3][2])();   // [kernel][precision]
+    void (FluidSim::*integrate)(float dt);
+    void (FluidSim::*integrateAndPack[2])(float dt); // [boundary]
+    void (FluidSim::*enforceBoundaries[2])();        // [boundary]
+  };
+  SolverPasses passes_ = {};
+  void SelectPasses();
+  template <CpuIsa I> static PassTable MakePassTable();
+  float KernelW(float r2) const; // cold-path W of the current kernel
 
-  float Poly6(float r2) const;
-  glm::vec2 SpikyGrad(glm::vec2 r_vec, float r_len) const;
-  float ViscLaplacian(float r_len) const;
+  template <class Kernel, class Real, CpuIsa I> void DensityPass();
+  template <class Kernel, class Real, CpuIsa I> void ForcePass();
+  template <class Kernel, class Real, CpuIsa I>
+  glm::vec2 ForceOn(const Kernel &kernel, int i) const;
+  template <CpuIsa I> void IntegratePass(float dt);
+  template <BoundaryMode B, CpuIsa I> void IntegrateAndPackPass(float dt);
+  template <BoundaryMode B, CpuIsa I> void EnforceBoundariesPass();
+  template <BoundaryMode B, CpuIsa I> void EnforceBoundary(Particle &p);
 
-  void ComputeDensityPressure();
-  void ComputeForces();
-  void Integrate(float dt);
-  void EnforceBoundaries();
+  void ComputeDensityPressure() { (this->*passes_.density)(); }
+  void ComputeForces() { (this->*passes_.forces)(); }
+  void Integrate(float dt) { (this->*passes_.integrate)(dt); }
+  void IntegrateAndPack(float dt);
+  void EnforceBoundaries() { (this->*passes_.enforceBoundaries)(); }
   void SpawnParticles(float dt);
-  void ResolveObstacle(Particle &p);
-  glm::vec2 ClosestOnSegment(glm::vec2 p, glm::vec2 a, glm::vec2 b) const;
+  void DrainSinks();
+  void EmitBatch(int index, Particle *batch);
+  void ResetEmitters();
+  void BuildBoundarySdf();
+  void BuildBoundaryParticles();
+  void BuildNeighborGrid();
+  void ClassifyParticles();
+  int RateLevel(float speed, float accel) const;
+  void UpdateCellState();
+  float LatticeDensity(float spacing) const;
+  float SpacingForDensity(float density) const;
+  void PackInstances();
 
   void InitParticleGL();
   void InitSceneGL();
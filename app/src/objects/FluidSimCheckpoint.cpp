@@ -0,0 +1,436 @@
+// FluidSim::SaveCheckpoint / LoadCheckpoint.
+//
+// Layout: a header, a table of sections, then each section's elements at a
+// 64-byte aligned offset, in native byte order and exactly as the solver
+// keeps them in memory. Loading maps the file and copies every section into
+// place as one block; nothing is parsed per element. Bump checkpointVersion
+// whenever a section's layout changes: older files are then rejected
+// instead of misread.
+#include "FluidSim.h"
+#include "MappedFile.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <sstream>
+#include <type_traits>
+
+namespace {
+
+constexpr char checkpointMagic[8] = {'F', 'L', 'U', 'I', 'D', 'C', 'K', 0};
+constexpr uint32_t checkpointVersion = 1;
+constexpr uint32_t endianTag = 0x01020304;
+constexpr size_t sectionAlign = 64;
+
+enum SectionId : uint32_t {
+  ParamsSection = 1,
+  ParticlesSection,
+  SlotHandlesSection,
+  HandleSlotsSection,
+  GenerationsSection,
+  FreeHandlesSection,
+  EmittersSection,
+  CellsSection,
+  SceneInfoSection,
+  SceneNameSection,
+  PolygonSizesSection,
+  PolygonPointsSection,
+  PolylineSizesSection,
+  PolylineWidthsSection,
+  PolylinePointsSection,
+  SceneEmittersSection,
+  SceneSinksSection,
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint32_t sectionCount;
+  uint32_t reserved;
+  uint64_t fileBytes;
+  uint64_t stateChecksum; // GetStateChecksum() when saved
+};
+
+struct Section {
+  uint32_t id;
+  uint32_t elemBytes;
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct Params {
+  float gravity, viscosity, gasConstant, renderRadius;
+  float baseColor[3];
+  float maxSpeed;
+  int32_t quality, capacity, drained;
+  int32_t kernel, precision, boundaryMode, collisionMode;
+  uint8_t boundaryParticles, sleeping, multiRate, running;
+};
+
+struct EmitterRecord {
+  float timer;
+  int32_t first, count;
+  uint32_t rng; // minstd_rand state; seed(state) restores it exactly
+};
+
+struct SceneInfo {
+  glm::vec2 containerMin, containerMax;
+  int32_t sdfResolution;
+};
+
+static_assert(std::is_trivially_copyable_v<Particle>);
+static_assert(std::is_trivially_copyable_v<SceneEmitter>);
+static_assert(std::is_trivially_copyable_v<SceneSink>);
+
+size_t AlignUp(size_t n) {
+  return (n + sectionAlign - 1) / sectionAlign * sectionAlign;
+}
+
+uint32_t RngState(const std::minstd_rand &rng) {
+  std::ostringstream os;
+  os << rng;
+  return (uint32_t)std::stoul(os.str());
+}
+
+class SectionWriter {
+public:
+  template <class T> void Add(uint32_t id, const T *data, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    sections_.push_back({{id, (uint32_t)sizeof(T), 0, count}, data});
+  }
+  template <class T> void Add(uint32_t id, const std::vector<T> &v) {
+    Add(id, v.data(), v.size());
+  }
+
+  bool Write(const std::string &path, uint64_t checksum) {
+    Header h = {};
+    std::memcpy(h.magic, checkpointMagic, sizeof(h.magic));
+    h.version = checkpointVersion;
+    h.endian = endianTag;
+    h.sectionCount = (uint32_t)sections_.size();
+    size_t offset =
+        AlignUp(sizeof(Header) + sections_.size() * sizeof(Section));
+    std::vector<Section> table;
+    for (Pending &p : sections_) {
+      p.section.offset = offset;
+      table.push_back(p.section);
+      offset = AlignUp(offset + p.section.elemBytes * p.section.count);
+    }
+    h.fileBytes = offset;
+    h.stateChecksum = checksum;
+
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f) {
+      std::cerr << "Cannot write checkpoint " << path << "\n";
+      return false;
+    }
+    f.write((const char *)&h, sizeof(h));
+    f.write((const char *)table.data(), table.size() * sizeof(Section));
+    for (const Pending &p : sections_) {
+      Pad(f, p.section.offset);
+      f.write((const char *)p.data, p.section.elemBytes * p.section.count);
+    }
+    Pad(f, h.fileBytes);
+    if (!f) {
+      std::cerr << "Cannot write checkpoint " << path << "\n";
+      return false;
+    }
+    return true;
+  }
+
+private:
+  struct Pending {
+    Section section;
+    const void *data;
+  };
+  std::vector<Pending> sections_;
+
+  static void Pad(std::ofstream &f, uint64_t to) {
+    static const char zeros[sectionAlign] = {};
+    uint64_t at = (uint64_t)f.tellp();
+    if (to > at)
+      f.write(zeros, (std::streamsize)(to - at));
+  }
+};
+
+class SectionReader {
+public:
+  SectionReader(const MappedFile &file, const std::string &path)
+      : file_(file), path_(path) {}
+
+  bool ReadHeader(Header &h) {
+    if (file_.GetSize() < sizeof(Header))
+      return Fail("not a checkpoint");
+    std::memcpy(&h, file_.GetData(), sizeof(Header));
+    if (std::memcmp(h.magic, checkpointMagic, sizeof(h.magic)))
+      return Fail("not a checkpoint");
+    if (h.endian != endianTag)
+      return Fail("written on a machine of the other byte order");
+    if (h.version != checkpointVersion)
+      return Fail("version " + std::to_string(h.version) + ", expected " +
+                  std::to_string(checkpointVersion));
+    if (h.fileBytes != file_.GetSize() ||
+        sizeof(Header) + (uint64_t)h.sectionCount * sizeof(Section) >
+            file_.GetSize())
+      return Fail("truncated");
+    table_ = (const Section *)(file_.GetData() + sizeof(Header));
+    count_ = h.sectionCount;
+    return true;
+  }
+
+  template <class T> bool Get(uint32_t id, std::span<const T> &out) {
+    for (uint32_t i = 0; i < count_; ++i) {
+      const Section &s = table_[i];
+      if (s.id != id)
+        continue;
+      if (s.elemBytes != sizeof(T))
+        return Fail("section " + std::to_string(id) + " has " +
+                    std::to_string(s.elemBytes) + "-byte elements");
+      if (s.offset % alignof(T) || s.offset > file_.GetSize() ||
+          s.count > (file_.GetSize() - s.offset) / sizeof(T))
+        return Fail("section " + std::to_string(id) + " out of bounds");
+      out = {(const T *)(file_.GetData() + s.offset), (size_t)s.count};
+      return true;
+    }
+    return Fail("section " + std::to_string(id) + " missing");
+  }
+  template <class T> bool GetOne(uint32_t id, T &out) {
+    std::span<const T> s;
+    if (!Get(id, s))
+      return false;
+    if (s.size() != 1)
+      return Fail("section " + std::to_string(id) + " malformed");
+    out = s[0];
+    return true;
+  }
+
+  bool Fail(const std::string &what) {
+    std::cerr << "Checkpoint " << path_ << ": " << what << "\n";
+    return false;
+  }
+
+private:
+  const MappedFile &file_;
+  const std::string &path_;
+  const Section *table_ = nullptr;
+  uint32_t count_ = 0;
+};
+
+} // namespace
+
+bool FluidSim::SaveCheckpoint(const std::string &path) const {
+  Params p;
+  std::memset(&p, 0, sizeof(p)); // padding too, for byte-stable files
+  p.gravity = gravity_;
+  p.viscosity = viscosity_;
+  p.gasConstant = gasConstant_;
+  p.renderRadius = renderRadius_;
+  p.baseColor[0] = baseColor_.x;
+  p.baseColor[1] = baseColor_.y;
+  p.baseColor[2] = baseColor_.z;
+  p.maxSpeed = maxSpeed_;
+  p.quality = quality_;
+  p.capacity = capacity_;
+  p.drained = drained_;
+  p.kernel = (int32_t)kernel_;
+  p.precision = (int32_t)precision_;
+  p.boundaryMode = (int32_t)boundaryMode_;
+  p.collisionMode = (int32_t)collisionMode_;
+  p.boundaryParticles = boundaryParticles_;
+  p.sleeping = sleeping_;
+  p.multiRate = multiRate_;
+  p.running = running_;
+
+  std::vector<EmitterRecord> emitters;
+  for (const EmitterState &st : emitterState_)
+    emitters.push_back({st.timer, st.first, st.count, RngState(st.rng)});
+
+  SceneInfo info = {scene_.containerMin, scene_.containerMax,
+                    scene_.sdfResolution};
+  std::vector<uint32_t> polygonSizes, polylineSizes;
+  std::vector<glm::vec2> polygonPoints, polylinePoints;
+  std::vector<float> polylineWidths;
+  for (const auto &poly : scene_.polygons) {
+    polygonSizes.push_back((uint32_t)poly.size());
+    polygonPoints.insert(polygonPoints.end(), poly.begin(), poly.end());
+  }
+  for (const auto &line : scene_.polylines) {
+    polylineSizes.push_back((uint32_t)line.pts.size());
+    polylineWidths.push_back(line.thickness);
+    polylinePoints.insert(polylinePoints.end(), line.pts.begin(),
+                          line.pts.end());
+  }
+
+  SectionWriter w;
+  w.Add(ParamsSection, &p, 1);
+  w.Add(ParticlesSection, particles_);
+  uint32_t handleSection = SlotHandlesSection;
+  handles_.VisitTables(
+      [&](const auto &table) { w.Add(handleSection++, table); });
+  w.Add(EmittersSection, emitters);
+  w.Add(CellsSection, cellState_);
+  w.Add(SceneInfoSection, &info, 1);
+  w.Add(SceneNameSection, scene_.name.data(), scene_.name.size());
+  w.Add(PolygonSizesSection, polygonSizes);
+  w.Add(PolygonPointsSection, polygonPoints);
+  w.Add(PolylineSizesSection, polylineSizes);
+  w.Add(PolylineWidthsSection, polylineWidths);
+  w.Add(PolylinePointsSection, polylinePoints);
+  w.Add(SceneEmittersSection, scene_.emitters);
+  w.Add(SceneSinksSection, scene_.sinks);
+  return w.Write(path, GetStateChecksum());
+}
+
+bool FluidSim::LoadCheckpoint(const std::string &path) {
+  MappedFile file;
+  if (!file.Open(path))
+    return false;
+  SectionReader r(file, path);
+  Header h;
+  if (!r.ReadHeader(h))
+    return false;
+
+  // Validate everything before touching the solver, so a bad file leaves
+  // the current state alone.
+  Params p;
+  SceneInfo info;
+  std::span<const Particle> particles;
+  std::span<const EmitterRecord> emitters;
+  std::span<const CellState> cells;
+  std::span<const char> name;
+  std::span<const uint32_t> polygonSizes, polylineSizes;
+  std::span<const glm::vec2> polygonPoints, polylinePoints;
+  std::span<const float> polylineWidths;
+  std::span<const SceneEmitter> sceneEmitters;
+  std::span<const SceneSink> sceneSinks;
+  if (!r.GetOne(ParamsSection, p) || !r.Get(ParticlesSection, particles) ||
+      !r.Get(EmittersSection, emitters) || !r.Get(CellsSection, cells) ||
+      !r.GetOne(SceneInfoSection, info) || !r.Get(SceneNameSection, name) ||
+      !r.Get(PolygonSizesSection, polygonSizes) ||
+      !r.Get(PolygonPointsSection, polygonPoints) ||
+      !r.Get(PolylineSizesSection, polylineSizes) ||
+      !r.Get(PolylineWidthsSection, polylineWidths) ||
+      !r.Get(PolylinePointsSection, polylinePoints) ||
+      !r.Get(SceneEmittersSection, sceneEmitters) ||
+      !r.Get(SceneSinksSection, sceneSinks))
+    return false;
+  if (p.kernel < 0 || p.kernel > 2 || p.precision < 0 || p.precision > 1 ||
+      p.boundaryMode < 0 || p.boundaryMode > 1 || p.collisionMode < 0 ||
+      p.collisionMode > 1 || p.capacity < (int64_t)particles.size() ||
+      p.capacity > maxCapacity)
+    return r.Fail("bad parameters");
+  // Only the particles are checksummed; everything else is range-checked.
+  for (float v : {p.gravity, p.viscosity, p.gasConstant, p.renderRadius,
+                  p.maxSpeed})
+    if (!std::isfinite(v))
+      return r.Fail("bad parameters");
+  if (!(p.renderRadius >= 0.001f && p.renderRadius <= 1.0f) ||
+      std::abs(p.gravity) > 100.0f)
+    return r.Fail("bad parameters");
+  for (const auto &e : emitters)
+    if (!std::isfinite(e.timer))
+      return r.Fail("bad emitter state");
+  for (const CellState &c : cells) {
+    uint8_t sleeping; // any byte but 0 or 1 is not a valid bool
+    std::memcpy(&sleeping, &c.sleeping, 1);
+    if (sleeping > 1 || c.level > maxRateLevel_)
+      return r.Fail("bad cell state");
+  }
+  if (emitters.size() != sceneEmitters.size() ||
+      polylineWidths.size() != polylineSizes.size())
+    return r.Fail("scene sections disagree");
+  if (ChecksumParticles(particles) != h.stateChecksum)
+    return r.Fail("particle checksum mismatch, the file is corrupt");
+
+  ParticleHandles handles;
+  bool ok = true;
+  uint32_t handleSection = SlotHandlesSection;
+  handles.VisitTables([&](auto &table) {
+    using T = typename std::remove_reference_t<decltype(table)>::value_type;
+    std::span<const T> s;
+    if (ok && (ok = r.Get(handleSection, s)))
+      table.assign(s.begin(), s.end());
+    ++handleSection;
+  });
+  if (!ok)
+    return false;
+  // Handle entries index the particle array.
+  if (handles.GetCount() != (int)particles.size() ||
+      !handles.IsValid(maxCapacity))
+    return r.Fail("handle table does not match the particles");
+
+  Scene scene;
+  scene.name.assign(name.begin(), name.end());
+  scene.containerMin = info.containerMin;
+  scene.containerMax = info.containerMax;
+  scene.sdfResolution = info.sdfResolution;
+  size_t at = 0;
+  for (uint32_t n : polygonSizes) {
+    if (n > polygonPoints.size() - at)
+      return r.Fail("polygon points out of range");
+    scene.polygons.emplace_back(polygonPoints.begin() + at,
+                                polygonPoints.begin() + at + n);
+    at += n;
+  }
+  at = 0;
+  for (size_t i = 0; i < polylineSizes.size(); ++i) {
+    uint32_t n = polylineSizes[i];
+    if (n > polylinePoints.size() - at)
+      return r.Fail("polyline points out of range");
+    ScenePolyline line;
+    line.pts.assign(polylinePoints.begin() + at,
+                    polylinePoints.begin() + at + n);
+    line.thickness = polylineWidths[i];
+    scene.polylines.push_back(std::move(line));
+    at += n;
+  }
+  scene.emitters.assign(sceneEmitters.begin(), sceneEmitters.end());
+  scene.sinks.assign(sceneSinks.begin(), sceneSinks.end());
+  std::string problem = scene.Validate();
+  if (!problem.empty())
+    return r.Fail("scene " + problem);
+
+  // Scene first: LoadScene() resets the particles and emitter clocks.
+  LoadScene(scene);
+  gravity_ = p.gravity;
+  viscosity_ = glm::clamp(p.viscosity, 0.0f, 10.0f);
+  gasConstant_ = glm::clamp(p.gasConstant, 1.0f, 200.0f);
+  SetQuality(p.quality);
+  baseColor_ = {p.baseColor[0], p.baseColor[1], p.baseColor[2]};
+  renderRadius_ = p.renderRadius;
+  precision_ = (Precision)p.precision;
+  boundaryMode_ = (BoundaryMode)p.boundaryMode;
+  collisionMode_ = (CollisionMode)p.collisionMode;
+  boundaryParticles_ = p.boundaryParticles != 0;
+  sleeping_ = p.sleeping != 0;
+  multiRate_ = p.multiRate != 0;
+  running_ = p.running != 0;
+  SetKernel((KernelFamily)p.kernel); // passes, boundary samples, radius
+  SetCapacity(p.capacity);
+
+  file.WillNeed((size_t)((const uint8_t *)particles.data() - file.GetData()),
+                particles.size_bytes());
+  particles_.assign(particles.begin(), particles.end());
+  handles_ = std::move(handles);
+  handles_.Reserve(capacity_);
+  for (size_t i = 0; i < emitters.size(); ++i) {
+    EmitterState &st = emitterState_[i];
+    st.timer = emitters[i].timer;
+    st.first = emitters[i].first;
+    st.count = emitters[i].count;
+    st.rng.seed(emitters[i].rng);
+  }
+  drained_ = p.drained;
+  maxSpeed_ = p.maxSpeed;
+
+  // The cell state indexes the grid, so lay the grid out before it is used.
+  BuildNeighborGrid();
+  if ((int)cells.size() == grid_.GetCellCount())
+    cellState_.assign(cells.begin(), cells.end());
+  else
+    WakeAll();
+  PackInstances();
+  return true;
+}
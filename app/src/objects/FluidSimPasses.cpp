@@ -0,0 +1,4 @@
+#include "FluidSimPasses.h"
+
+// Baseline build of the solver passes: the compiler's default target.
+template FluidSim::PassTable FluidSim::MakePassTable<CpuIsa::Generic>();
@@ -0,0 +1,241 @@
+#pragma once
+// Definitions of FluidSim's hot passes. Included only by the
+// FluidSimPasses*.cpp files, each of which instantiates MakePassTable<I>
+// for its level and may define FLUID_PASS_TARGET, the instruction set
+// extensions for that level (GCC/Clang target attribute syntax).
+//
+// The extensions apply per function, to the definitions below only, not
+// with -march for the whole file. The inline functions and templates of
+// the shared headers (glm, the kernel policies, FluidSim, std::vector) are
+// then emitted at the baseline target even in the AVX-512 file, so
+// whichever copy the linker keeps is safe on any CPU, also at -O0 where
+// nothing is inlined. The ISA parameter gives every pass and every lambda
+// in it a symbol of its own, so those are never shared between levels.
+#include "FluidSim.h"
+#include "JobSystem.h"
+#include "SphKernels.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(FLUID_PASS_TARGET) && defined(__GNUC__) &&                       \
+    (defined(__x86_64__) || defined(__i386__))
+#define FLUID_PASS_PRAGMA(x) _Pragma(#x)
+#if defined(__clang__)
+#define FLUID_PASS_TARGET_PUSH(t)                                             \
+  FLUID_PASS_PRAGMA(clang attribute push(__attribute__((target(t))),        \
+                                         apply_to = function))
+#define FLUID_PASS_TARGET_POP FLUID_PASS_PRAGMA(clang attribute pop)
+#else
+#define FLUID_PASS_TARGET_PUSH(t)                                             \
+  FLUID_PASS_PRAGMA(GCC push_options) FLUID_PASS_PRAGMA(GCC target(t))
+#define FLUID_PASS_TARGET_POP FLUID_PASS_PRAGMA(GCC pop_options)
+#endif
+FLUID_PASS_TARGET_PUSH(FLUID_PASS_TARGET)
+#endif
+
+// The per-particle passes below run under JobSystem::ParallelFor. Each
+// particle writes only its own fields and reads what earlier passes left in
+// its neighbours, and its sums run in the grid's fixed neighbour order, so
+// results are bit-identical for any thread count. The ISA variants are
+// built without floating-point contraction and give the same bits too.
+//
+// Real only widens the sums: pair terms are evaluated in float either way,
+// and Real = float reproduces the untemplated solver bit for bit.
+
+template <class Kernel, class Real, CpuIsa I>
+void FluidSim::DensityPass() {
+  const Kernel kernel(h_);
+  int n = (int)particles_.size();
+  JobSystem::Get().ParallelFor(n, 256, [&](int b, int e) {
+    for (int i = b; i < e; ++i) {
+      if (!Kicked(i))
+        continue;
+      Particle &pi = particles_[i];
+      Real rho = 0;
+      grid_.ForEachNeighbor(pi.pos, [&](int j) {
+        glm::vec2 r = pi.pos - particles_[j].pos;
+        rho += mass_ * kernel.W(glm::dot(r, r));
+      });
+      if (boundaryParticles_) {
+        boundaryGrid_.ForEachNeighbor(pi.pos, [&](int k) {
+          glm::vec2 r = pi.pos - boundaryPos_[k];
+          rho +=
+              boundaryRho0_ * boundaryVolume_[k] * kernel.W(glm::dot(r, r));
+        });
+      }
+      pi.density = std::max((float)rho, 0.001f);
+      pi.pressure = gasConstant_ * (pi.density - restDensity_);
+    }
+  });
+}
+
+template <class Kernel, class Real, CpuIsa I>
+void FluidSim::ForcePass() {
+  const Kernel kernel(h_);
+  int n = (int)particles_.size();
+  JobSystem::Get().ParallelFor(n, 256, [&](int b, int e) {
+    for (int i = b; i < e; ++i)
+      if (Kicked(i))
+        particles_[i].force = ForceOn<Kernel, Real, I>(kernel, i);
+  });
+}
+
+template <class Kernel, class Real, CpuIsa I>
+glm::vec2 FluidSim::ForceOn(const Kernel &kernel, int i) const {
+  using Vec = glm::vec<2, Real>;
+  const Particle &pi = particles_[i];
+  Vec fp(0), fv(0);
+  grid_.ForEachNeighbor(pi.pos, [&](int j) {
+    if (i == j)
+      return;
+    const Particle &pj = particles_[j];
+    glm::vec2 r_vec = pi.pos - pj.pos;
+    float r_len = glm::length(r_vec);
+    if (r_len >= h_ || r_len < 1e-6f)
+      return;
+
+    float avgP = (pi.pressure + pj.pressure) * 0.5f;
+    fp += Vec(-mass_ * avgP / pj.density * kernel.Grad(r_vec, r_len));
+
+    fv += Vec(viscosity_ * mass_ * (pj.vel - pi.vel) / pj.density *
+              kernel.ViscLap(r_len));
+  });
+
+  if (boundaryParticles_) {
+    // Akinci et al. 2012: boundary samples mirror the fluid particle's own
+    // pressure and density; only repulsion is kept to avoid wall sticking.
+    float pTerm = boundaryRho0_ * std::max(pi.pressure, 0.0f) / pi.density;
+    boundaryGrid_.ForEachNeighbor(pi.pos, [&](int b) {
+      glm::vec2 r_vec = pi.pos - boundaryPos_[b];
+      float r_len = glm::length(r_vec);
+      if (r_len >= h_ || r_len < 1e-6f)
+        return;
+      fp += Vec(-boundaryVolume_[b] * pTerm * kernel.Grad(r_vec, r_len));
+    });
+  }
+
+  Vec fg(0, -gravity_ * pi.density);
+  return glm::vec2(fp + fv + fg);
+}
+
+template <CpuIsa I> void FluidSim::IntegratePass(float dt) {
+  int n = (int)particles_.size();
+  JobSystem::Get().ParallelFor(n, 1024, [&](int b, int e) {
+    for (int i = b; i < e; ++i) {
+      if (asleep_[i])
+        continue;
+      Particle &p = particles_[i];
+      if (Kicked(i))
+        p.vel += (rateMask_[i] + 1) * dt * p.force / p.density;
+      p.pos += dt * p.vel;
+      p.vel *= 0.9998f;
+    }
+  });
+}
+
+template <BoundaryMode B, CpuIsa I>
+void FluidSim::IntegrateAndPackPass(float dt) {
+  const int grain = packGrain_;
+  int n = (int)particles_.size();
+  JobSystem::Get().ParallelFor(n, grain, [&](int b, int e) {
+    float maxSpeed = 0.1f;
+    for (int i = b; i < e; ++i) {
+      Particle &p = particles_[i];
+      if (asleep_[i]) {
+        instances_[i] = {p.pos.x, p.pos.y, 0.0f};
+        continue;
+      }
+      // Every level ends its block on the last substep.
+      p.vel += (rateMask_[i] + 1) * dt * p.force / p.density;
+      p.pos += dt * p.vel;
+      p.vel *= 0.9998f;
+      EnforceBoundary<B, I>(p);
+
+      float s = glm::length(p.vel);
+      maxSpeed = std::max(maxSpeed, s);
+      instances_[i] = {p.pos.x, p.pos.y, s};
+    }
+    chunkMaxSpeed_[b / grain] = maxSpeed;
+  });
+}
+
+template <BoundaryMode B, CpuIsa I>
+void FluidSim::EnforceBoundariesPass() {
+  int n = (int)particles_.size();
+  JobSystem::Get().ParallelFor(n, 1024, [&](int b, int e) {
+    for (int i = b; i < e; ++i)
+      if (!asleep_[i])
+        EnforceBoundary<B, I>(particles_[i]);
+  });
+}
+
+template <BoundaryMode B, CpuIsa I>
+void FluidSim::EnforceBoundary(Particle &p) {
+  if constexpr (B == BoundaryMode::Exact) {
+    glm::vec2 lo = scene_.containerMin + glm::vec2(renderRadius_);
+    glm::vec2 hi = scene_.containerMax - glm::vec2(renderRadius_);
+    for (int a = 0; a < 2; ++a) {
+      if (p.pos[a] < lo[a]) {
+        p.pos[a] = lo[a];
+        p.vel[a] = std::abs(p.vel[a]) * restitution_;
+      }
+      if (p.pos[a] > hi[a]) {
+        p.pos[a] = hi[a];
+        p.vel[a] = -std::abs(p.vel[a]) * restitution_;
+      }
+    }
+
+    sdf_.GetBvh().ForEachWithin(
+        p.pos, renderRadius_, [&](const SegmentHit &h) {
+          p.pos += h.normal * (renderRadius_ - h.dist);
+          float vn = glm::dot(p.vel, h.normal);
+          if (vn < 0.0f)
+            p.vel -= (1.0f + restitution_) * vn * h.normal;
+        });
+  } else {
+    SdfSample s = sdf_.Sample(p.pos);
+    if (s.dist >= renderRadius_)
+      return;
+    float gl = glm::length(s.grad);
+    if (gl < 1e-6f)
+      return;
+    glm::vec2 n = s.grad / gl;
+    p.pos += n * (renderRadius_ - s.dist);
+    float vn = glm::dot(p.vel, n);
+    if (vn < 0.0f)
+      p.vel -= (1.0f + restitution_) * vn * n;
+  }
+}
+
+template <CpuIsa I> FluidSim::PassTable FluidSim::MakePassTable() {
+  using K0 = MullerKernels;
+  using K1 = WendlandKernels;
+  using K2 = CubicSplineKernels;
+  using F = float;
+  using D = double;
+  constexpr BoundaryMode Sdf = BoundaryMode::Sdf;
+  constexpr BoundaryMode Exact = BoundaryMode::Exact;
+  return {
+      .density = {{&FluidSim::DensityPass<K0, F, I>,
+                   &FluidSim::DensityPass<K0, D, I>},
+                  {&FluidSim::DensityPass<K1, F, I>,
+                   &FluidSim::DensityPass<K1, D, I>},
+                  {&FluidSim::DensityPass<K2, F, I>,
+                   &FluidSim::DensityPass<K2, D, I>}},
+      .forces = {{&FluidSim::ForcePass<K0, F, I>,
+                  &FluidSim::ForcePass<K0, D, I>},
+                 {&FluidSim::ForcePass<K1, F, I>,
+                  &FluidSim::ForcePass<K1, D, I>},
+                 {&FluidSim::ForcePass<K2, F, I>,
+                  &FluidSim::ForcePass<K2, D, I>}},
+      .integrate = &FluidSim::IntegratePass<I>,
+      .integrateAndPack = {&FluidSim::IntegrateAndPackPass<Sdf, I>,
+                           &FluidSim::IntegrateAndPackPass<Exact, I>},
+      .enforceBoundaries = {&FluidSim::EnforceBoundariesPass<Sdf, I>,
+                            &FluidSim::EnforceBoundariesPass<Exact, I>},
+  };
+}
+
+#ifdef FLUID_PASS_TARGET_POP
+FLUID_PASS_TARGET_POP
+#endif
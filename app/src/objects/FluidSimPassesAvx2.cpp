@@ -0,0 +1,5 @@
+// The extensions of x86-64-v3, for the pass definitions only.
+#define FLUID_PASS_TARGET "avx2,fma,bmi,bmi2,f16c,lzcnt,movbe,popcnt"
+#include "FluidSimPasses.h"
+
+template FluidSim::PassTable FluidSim::MakePassTable<CpuIsa::Avx2>();
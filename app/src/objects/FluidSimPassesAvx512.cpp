@@ -0,0 +1,6 @@
+// The extensions of x86-64-v4, for the pass definitions only.
+#define FLUID_PASS_TARGET                                                      \
+  "avx512f,avx512bw,avx512cd,avx512dq,avx512vl,fma,bmi,bmi2,f16c,lzcnt,movbe"
+#include "FluidSimPasses.h"
+
+template FluidSim::PassTable FluidSim::MakePassTable<CpuIsa::Avx512>();
@@ -0,0 +1,5 @@
+// The extensions of x86-64-v2, for the pass definitions only.
+#define FLUID_PASS_TARGET "sse4.2,popcnt"
+#include "FluidSimPasses.h"
+
+template FluidSim::PassTable FluidSim::MakePassTable<CpuIsa::Sse42>();
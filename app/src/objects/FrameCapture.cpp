@@ -0,0 +1,139 @@
+#include "FrameCapture.h"
+#include <cstring>
+#include <iostream>
+
+bool FrameCapture::Start(const std::string &dir, const std::string &prefix,
+                         ImageFormat format, int width, int height,
+                         int frames) {
+  Finish();
+  Resize(width, height);
+  if (!images_.Open(dir, prefix, format, width, height))
+    return false;
+  toVideo_ = false;
+  remaining_ = frames;
+  queued_ = gpuWaits_ = dropped_ = 0;
+  return true;
+}
+
+bool FrameCapture::StartVideo(const std::string &path, int width, int height,
+                              int fps, int frames) {
+  Finish();
+  Resize(width, height);
+  if (!video_.Open(path, width, height, fps))
+    return false;
+  toVideo_ = true;
+  remaining_ = frames;
+  queued_ = gpuWaits_ = dropped_ = 0;
+  return true;
+}
+
+void FrameCapture::Resize(int width, int height) {
+  if (width != width_ || height != height_)
+    ReleaseBuffers();
+  width_ = width;
+  height_ = height;
+}
+
+void FrameCapture::Update() {
+  // Hand over every readback that has landed, oldest first.
+  while (pending_ > 0) {
+    Slot &oldest = ring_[(head_ - pending_ + ringSize_) % ringSize_];
+    GLenum r = glClientWaitSync(oldest.fence, 0, 0);
+    if (r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED)
+      break;
+    Retire(oldest, false);
+  }
+  if (remaining_ == 0)
+    return;
+
+  if (pending_ == ringSize_) {
+    ++gpuWaits_;
+    Retire(ring_[head_], true); // the oldest, about to be reused
+  }
+  Slot &slot = ring_[head_];
+  GLsizeiptr bytes = (GLsizeiptr)width_ * height_ * 4;
+  if (!slot.pbo) {
+    glGenBuffers(1, &slot.pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  head_ = (head_ + 1) % ringSize_;
+  ++pending_;
+  ++queued_;
+  if (remaining_ > 0)
+    --remaining_;
+}
+
+void FrameCapture::Retire(Slot &slot, bool wait) {
+  if (wait)
+    while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                            1000000000) == GL_TIMEOUT_EXPIRED) {
+    }
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+  --pending_;
+
+  size_t bytes = (size_t)width_ * height_ * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  const void *pixels =
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+  // A buffer whose unmap fails held garbage; its frame is not submitted,
+  // and the writer hands out the same buffer again.
+  bool copied = false;
+  if (pixels) {
+    std::memcpy(toVideo_ ? video_.BeginFrame() : images_.BeginFrame(),
+                pixels, bytes);
+    copied = glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+  }
+  if (copied) {
+    if (toVideo_)
+      video_.SubmitFrame();
+    else
+      images_.SubmitFrame();
+  } else {
+    std::cerr << "Frame capture: cannot read back frame "
+              << queued_ - pending_ - 1 << " (GL error 0x" << std::hex
+              << glGetError() << std::dec << "), dropped\n";
+    ++dropped_;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool FrameCapture::Finish() {
+  remaining_ = 0;
+  while (pending_ > 0)
+    Retire(ring_[(head_ - pending_ + ringSize_) % ringSize_], true);
+  bool ok = images_.Close();
+  return video_.Close() && ok && dropped_ == 0;
+}
+
+void FrameCapture::Shutdown() {
+  Finish();
+  ReleaseBuffers();
+}
+
+void FrameCapture::ReleaseBuffers() {
+  for (Slot &s : ring_) {
+    if (s.pbo)
+      glDeleteBuffers(1, &s.pbo);
+    s.pbo = 0;
+  }
+  head_ = 0;
+}
+
+FrameCaptureStats FrameCapture::GetStats() {
+  FramePoolStats w = toVideo_ ? video_.GetStats() : images_.GetStats();
+  FrameCaptureStats s;
+  s.queued = queued_;
+  s.written = w.frames;
+  s.bytes = w.bytes;
+  s.inFlight = pending_;
+  s.gpuWaits = gpuWaits_;
+  s.encoderStalls = w.stalls;
+  s.dropped = dropped_;
+  return s;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "ImageSequence.h"
+#include "Y4mWriter.h"
+#include <cstdint>
+#include <glad/glad.h>
+#include <string>
+
+struct FrameCaptureStats {
+  uint64_t queued = 0;   // readbacks started
+  uint64_t written = 0;  // frames written out
+  uint64_t bytes = 0;    // of written frames
+  int inFlight = 0;      // readbacks the GPU has not finished
+  uint64_t gpuWaits = 0; // ring full: waited for the oldest readback
+  uint64_t encoderStalls = 0;
+  uint64_t dropped = 0; // readbacks that could not be mapped
+};
+
+// Asynchronous framebuffer readback. Update() starts a glReadPixels into
+// one of a ring of pixel buffer objects and fences it; the copy runs on the
+// GPU while the next frames are drawn, and the buffer is mapped once its
+// fence has signalled, normally ringSize_ - 1 frames later. The pixels then
+// go to an ImageSequenceWriter or a Y4mWriter, whose threads encode and
+// write them. Nothing is dropped: a full ring waits for the GPU and a busy
+// encoder pool waits for a free buffer, and both are counted.
+//
+// Needs a current GL context for everything but GetStats().
+class FrameCapture {
+public:
+  // Captures the next `frames` frames (-1: until Stop()) as
+  // dir/<prefix>NNNNNN.<format>. Finishes an earlier capture first. Prints
+  // the reason and returns false if the writer cannot start.
+  bool Start(const std::string &dir, const std::string &prefix,
+             ImageFormat format, int width, int height, int frames = -1);
+  // The same into one Y4M stream at `fps` (path "-": stdout).
+  bool StartVideo(const std::string &path, int width, int height, int fps,
+                  int frames = -1);
+  // No more readbacks; the ones in flight still complete in Update().
+  void Stop() { remaining_ = 0; }
+  bool IsCapturing() const { return remaining_ != 0; }
+
+  // Call once per frame with the framebuffer to capture bound for reading,
+  // after drawing into it.
+  void Update();
+  // Waits for every readback and image. False if any image failed or any
+  // readback was dropped.
+  bool Finish();
+  // Finish() and delete the GL objects.
+  void Shutdown();
+
+  FrameCaptureStats GetStats();
+
+private:
+  static constexpr int ringSize_ = 3;
+
+  struct Slot {
+    GLuint pbo = 0;
+    GLsync fence = nullptr;
+  };
+
+  void Resize(int width, int height);
+  void Retire(Slot &slot, bool wait);
+  void ReleaseBuffers();
+
+  Slot ring_[ringSize_];
+  int head_ = 0;    // next slot to read into
+  int pending_ = 0; // fenced slots, oldest at head_ - pending_
+  int width_ = 0, height_ = 0;
+  int remaining_ = 0;
+  uint64_t queued_ = 0, gpuWaits_ = 0, dropped_ = 0;
+  bool toVideo_ = false; // frames go to video_ rather than images_
+  ImageSequenceWriter images_;
+  Y4mWriter video_;
+};
@@ -0,0 +1,118 @@
+#include "FramePool.h"
+#include <algorithm>
+
+// Buffers in flight per worker: one being encoded, one waiting.
+static constexpr int buffersPerWorker = 2;
+
+void FramePool::Open(size_t bufferBytes, int threads, bool ordered,
+                     EncodeFn encode, WriteFn write) {
+  Close();
+  ordered_ = ordered;
+  encode_ = std::move(encode);
+  write_ = std::move(write);
+  if (threads <= 0)
+    threads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+  buffers_.assign(threads * buffersPerWorker,
+                  std::vector<uint8_t>(bufferBytes));
+  free_.clear();
+  for (int i = 0; i < (int)buffers_.size(); ++i)
+    free_.push_back(i);
+  jobs_.clear();
+  current_ = -1;
+  nextFrame_ = 0;
+  nextWrite_ = 0;
+  quit_ = false;
+  failed_ = false;
+  stats_ = {};
+  for (int i = 0; i < threads; ++i)
+    workers_.emplace_back([this] { WorkerLoop(); });
+}
+
+uint8_t *FramePool::BeginFrame() {
+  std::unique_lock lock(mutex_);
+  if (current_ < 0) {
+    if (free_.empty()) {
+      ++stats_.stalls;
+      freed_.wait(lock, [this] { return !free_.empty(); });
+    }
+    current_ = free_.back();
+    free_.pop_back();
+  }
+  return buffers_[current_].data();
+}
+
+void FramePool::SubmitFrame() {
+  {
+    std::lock_guard lock(mutex_);
+    if (current_ < 0)
+      return;
+    jobs_.push_back({current_, nextFrame_++});
+    current_ = -1;
+  }
+  queued_.notify_one();
+}
+
+bool FramePool::Close() {
+  if (!IsOpen())
+    return true;
+  {
+    std::lock_guard lock(mutex_);
+    if (current_ >= 0)
+      free_.push_back(current_); // begun but never submitted
+    current_ = -1;
+    quit_ = true;
+  }
+  queued_.notify_all();
+  for (std::thread &t : workers_)
+    t.join();
+  workers_.clear();
+  buffers_.clear();
+  encode_ = nullptr;
+  write_ = nullptr;
+  return !failed_;
+}
+
+FramePoolStats FramePool::GetStats() {
+  std::lock_guard lock(mutex_);
+  return stats_;
+}
+
+void FramePool::WorkerLoop() {
+  std::vector<uint8_t> encoded;
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock lock(mutex_);
+      queued_.wait(lock, [this] { return !jobs_.empty() || quit_; });
+      if (jobs_.empty())
+        return;
+      job = jobs_.front();
+      jobs_.pop_front();
+    }
+    encode_(buffers_[job.buffer].data(), job.frame, encoded);
+    bool skip; // ordered: an earlier frame failed, the stream is broken
+    {
+      std::unique_lock lock(mutex_);
+      free_.push_back(job.buffer);
+      freed_.notify_one();
+      // Jobs leave the queue in frame order, so the frame due next is
+      // always held by some worker and this wait ends.
+      if (ordered_)
+        written_.wait(lock, [&] { return nextWrite_ == job.frame; });
+      skip = ordered_ && failed_;
+    }
+    bool ok = skip || write_(job.frame, encoded);
+    {
+      std::lock_guard lock(mutex_);
+      if (!ok) {
+        failed_ = true;
+      } else if (!skip) {
+        ++stats_.frames;
+        stats_.bytes += encoded.size();
+      }
+      ++nextWrite_;
+    }
+    if (ordered_)
+      written_.notify_all();
+  }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct FramePoolStats {
+  uint64_t frames = 0; // written
+  uint64_t bytes = 0;
+  uint64_t stalls = 0; // BeginFrame() calls that waited for a worker
+};
+
+// The buffer pool and worker threads behind the frame writers
+// (ImageSequenceWriter, Y4mWriter). The caller fills a pooled buffer
+// between BeginFrame() and SubmitFrame() while earlier frames are encoded
+// on the workers. A few buffers per worker are pooled; when all of them are
+// queued, BeginFrame() waits.
+//
+// Each frame is encoded, its buffer is released, and then the encoded bytes
+// are written. With `ordered`, writes happen strictly in frame order, and
+// after a failed write the later frames are dropped.
+class FramePool {
+public:
+  // Turns a submitted buffer into the frame's output bytes. Runs on the
+  // workers, several frames at a time.
+  using EncodeFn = std::function<void(const uint8_t *buffer, int frame,
+                                      std::vector<uint8_t> &encoded)>;
+  // Stores a frame's bytes. Prints the reason and returns false on failure.
+  using WriteFn =
+      std::function<bool(int frame, const std::vector<uint8_t> &encoded)>;
+
+  FramePool() = default;
+  ~FramePool() { Close(); }
+  FramePool(const FramePool &) = delete;
+  FramePool &operator=(const FramePool &) = delete;
+
+  // Closes an earlier run first. threads <= 0 uses all cores but one.
+  void Open(size_t bufferBytes, int threads, bool ordered, EncodeFn encode,
+            WriteFn write);
+  // bufferBytes for the next frame.
+  uint8_t *BeginFrame();
+  // Queues the buffer from BeginFrame() as the next frame.
+  void SubmitFrame();
+  // Waits for every queued frame. False if any write failed.
+  bool Close();
+  bool IsOpen() const { return !workers_.empty(); }
+  FramePoolStats GetStats();
+
+private:
+  struct Job {
+    int buffer;
+    int frame;
+  };
+
+  void WorkerLoop();
+
+  bool ordered_ = false;
+  EncodeFn encode_;
+  WriteFn write_;
+  std::vector<std::thread> workers_;
+
+  // Guarded by mutex_.
+  std::mutex mutex_;
+  std::condition_variable queued_;
+  std::condition_variable freed_;
+  std::condition_variable written_; // nextWrite_ advanced
+  std::vector<std::vector<uint8_t>> buffers_;
+  std::vector<int> free_;
+  std::deque<Job> jobs_;
+  int current_ = -1; // buffer between BeginFrame() and SubmitFrame()
+  int nextFrame_ = 0;
+  int nextWrite_ = 0; // ordered: only the worker holding this frame writes
+  bool quit_ = false;
+  bool failed_ = false;
+  FramePoolStats stats_;
+};
@@ -0,0 +1,283 @@
+#include "HeapCounter.h"
+#include <cstdlib>
+
+const char *AllocTagName(AllocTag tag) {
+  switch (tag) {
+  case AllocTag::Solver:
+    return "solver";
+  case AllocTag::Upload:
+    return "upload";
+  case AllocTag::Ui:
+    return "ui";
+  case AllocTag::Gl:
+    return "gl";
+  default:
+    return "other";
+  }
+}
+
+#if defined(NDEBUG) && !defined(FLUID_ALLOC_HOOK)
+
+AllocTagScope::AllocTagScope(AllocTag) : prev_(AllocTag::Other) {}
+AllocTagScope::~AllocTagScope() {}
+AllocTag CurrentAllocTag() { return AllocTag::Other; }
+bool AllocHookInstalled() { return false; }
+AllocStats ReadAllocStats() { return {}; }
+
+HeapCountScope::HeapCountScope() {}
+HeapCountScope::~HeapCountScope() {}
+uint64_t HeapCountScope::GetCount() const { return 0; }
+void TrackHeapAllocations() {}
+
+#else
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <new>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// glibc exports its allocator as __libc_*, so the C entry points can be
+// interposed and still reach the real ones. Every entry point that hands
+// out a block free() takes is hooked, so the per-tag balances hold.
+// Sanitizers bring their own.
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define FLUID_SANITIZED 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) ||  \
+    __has_feature(memory_sanitizer)
+#define FLUID_SANITIZED 1
+#endif
+#endif
+#if defined(__GLIBC__) && !defined(FLUID_SANITIZED)
+#define FLUID_HOOK_C_ALLOC 1
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t n, std::size_t size);
+void *__libc_realloc(void *p, std::size_t size);
+void __libc_free(void *p);
+void *__libc_memalign(std::size_t align, std::size_t size);
+void *__libc_valloc(std::size_t size);
+void *__libc_pvalloc(std::size_t size);
+}
+#endif
+
+namespace {
+// One counter block per thread keeps the hook itself off shared cache
+// lines; threads past the last block share it. Readers sum the blocks.
+constexpr int kSlots = 64;
+struct alignas(64) Slot {
+  std::atomic<uint64_t> allocs[AllocTagCount];
+  std::atomic<uint64_t> frees[AllocTagCount];
+  std::atomic<uint64_t> bytes[AllocTagCount];
+  std::atomic<uint64_t> tracked; // allocations while the thread is tracked
+};
+} // namespace
+
+static Slot g_slots[kSlots];
+static std::atomic<int> g_usedSlots{0};
+static thread_local int t_slot = -1;
+static thread_local AllocTag t_tag = AllocTag::Other;
+static thread_local bool t_tracked = false;
+
+static Slot &ThreadSlot() {
+  if (t_slot < 0)
+    t_slot = std::min(g_usedSlots.fetch_add(1, std::memory_order_relaxed),
+                      kSlots - 1);
+  return g_slots[t_slot];
+}
+
+static void CountAlloc(std::size_t size) {
+  Slot &s = ThreadSlot();
+  int t = (int)t_tag;
+  s.allocs[t].fetch_add(1, std::memory_order_relaxed);
+  s.bytes[t].fetch_add(size, std::memory_order_relaxed);
+  if (t_tracked)
+    s.tracked.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void CountFree() {
+  ThreadSlot().frees[(int)t_tag].fetch_add(1, std::memory_order_relaxed);
+}
+
+AllocTagScope::AllocTagScope(AllocTag tag) : prev_(t_tag) { t_tag = tag; }
+AllocTagScope::~AllocTagScope() { t_tag = prev_; }
+AllocTag CurrentAllocTag() { return t_tag; }
+bool AllocHookInstalled() { return true; }
+
+AllocStats ReadAllocStats() {
+  AllocStats r;
+  int used = std::min(g_usedSlots.load(std::memory_order_relaxed), kSlots);
+  for (int i = 0; i < used; ++i) {
+    for (int t = 0; t < AllocTagCount; ++t) {
+      r.tags[t].allocs += g_slots[i].allocs[t].load(std::memory_order_relaxed);
+      r.tags[t].frees += g_slots[i].frees[t].load(std::memory_order_relaxed);
+      r.tags[t].bytes += g_slots[i].bytes[t].load(std::memory_order_relaxed);
+    }
+  }
+  return r;
+}
+
+static uint64_t ReadTracked() {
+  uint64_t n = 0;
+  int used = std::min(g_usedSlots.load(std::memory_order_relaxed), kSlots);
+  for (int i = 0; i < used; ++i)
+    n += g_slots[i].tracked.load(std::memory_order_relaxed);
+  return n;
+}
+
+HeapCountScope::HeapCountScope()
+    : start_(ReadTracked()),
+      wasTracked_(t_tracked) {
+  t_tracked = true;
+}
+
+HeapCountScope::~HeapCountScope() { t_tracked = wasTracked_; }
+
+uint64_t HeapCountScope::GetCount() const {
+  return ReadTracked() - start_;
+}
+
+void TrackHeapAllocations() { t_tracked = true; }
+
+#ifdef FLUID_HOOK_C_ALLOC
+extern "C" {
+void *malloc(std::size_t size) noexcept {
+  CountAlloc(size);
+  return __libc_malloc(size);
+}
+void *calloc(std::size_t n, std::size_t size) noexcept {
+  CountAlloc(n * size);
+  return __libc_calloc(n, size);
+}
+// Moving or freeing a block counts as a free plus a new allocation.
+void *realloc(void *p, std::size_t size) noexcept {
+  if (p)
+    CountFree();
+  if (size || !p)
+    CountAlloc(size);
+  return __libc_realloc(p, size);
+}
+void free(void *p) noexcept {
+  if (p)
+    CountFree();
+  __libc_free(p);
+}
+void *memalign(std::size_t align, std::size_t size) noexcept {
+  CountAlloc(size);
+  return __libc_memalign(align, size);
+}
+void *aligned_alloc(std::size_t align, std::size_t size) noexcept {
+  CountAlloc(size);
+  return __libc_memalign(align, size);
+}
+int posix_memalign(void **out, std::size_t align, std::size_t size) noexcept {
+  if (align == 0 || align % sizeof(void *) != 0 ||
+      (align & (align - 1)) != 0)
+    return EINVAL;
+  CountAlloc(size);
+  void *p = __libc_memalign(align, size);
+  if (!p)
+    return ENOMEM;
+  *out = p;
+  return 0;
+}
+void *valloc(std::size_t size) noexcept {
+  CountAlloc(size);
+  return __libc_valloc(size);
+}
+void *pvalloc(std::size_t size) noexcept {
+  CountAlloc(size);
+  return __libc_pvalloc(size);
+}
+// glibc keeps its own reallocarray private; this is the same overflow
+// check in front of the realloc() above.
+void *reallocarray(void *p, std::size_t n, std::size_t size) noexcept {
+  std::size_t bytes;
+  if (__builtin_mul_overflow(n, size, &bytes)) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  return realloc(p, bytes);
+}
+}
+#define RAW_MALLOC __libc_malloc
+#define RAW_ALIGNED_ALLOC __libc_memalign
+#define RAW_FREE __libc_free
+#else
+#define RAW_MALLOC std::malloc
+#define RAW_ALIGNED_ALLOC std::aligned_alloc
+#define RAW_FREE std::free
+#endif
+
+static void *CountedNew(std::size_t size, std::size_t align) {
+  CountAlloc(size);
+  size = size ? size : 1;
+  if (align <= alignof(std::max_align_t))
+    return RAW_MALLOC(size);
+#ifdef _MSC_VER
+  return _aligned_malloc(size, align);
+#else
+  // aligned_alloc wants a multiple of the alignment.
+  return RAW_ALIGNED_ALLOC(align, (size + align - 1) / align * align);
+#endif
+}
+
+static void CountedDelete(void *p) {
+  if (!p)
+    return;
+  CountFree();
+  RAW_FREE(p);
+}
+
+static void AlignedDelete(void *p) {
+  if (!p)
+    return;
+  CountFree();
+#ifdef _MSC_VER
+  _aligned_free(p);
+#else
+  RAW_FREE(p);
+#endif
+}
+
+void *operator new(std::size_t size) {
+  if (void *p = CountedNew(size, 0))
+    return p;
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void *operator new(std::size_t size, std::align_val_t align) {
+  if (void *p = CountedNew(size, (std::size_t)align))
+    return p;
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return operator new(size, align);
+}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return CountedNew(size, 0);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return CountedNew(size, 0);
+}
+
+void operator delete(void *p) noexcept { CountedDelete(p); }
+void operator delete[](void *p) noexcept { CountedDelete(p); }
+void operator delete(void *p, std::size_t) noexcept { CountedDelete(p); }
+void operator delete[](void *p, std::size_t) noexcept { CountedDelete(p); }
+void operator delete(void *p, std::align_val_t) noexcept { AlignedDelete(p); }
+void operator delete[](void *p, std::align_val_t) noexcept {
+  AlignedDelete(p);
+}
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  AlignedDelete(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  AlignedDelete(p);
+}
+
+#endif
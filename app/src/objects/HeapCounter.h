@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+
+// Global allocation hook. Debug builds, and release builds configured with
+// FLUID_ALLOC_HOOK, replace the global operator new and, on glibc, malloc,
+// calloc, realloc, reallocarray, free and the aligned allocators
+// (memalign, posix_memalign, aligned_alloc, valloc, pvalloc), so C
+// allocations from ImGui and the GL driver are seen too. Elsewhere only
+// C++ allocations are counted. Without the hook the standard allocator is
+// untouched and every count reads zero.
+
+// Subsystem an allocation is charged to: the innermost AllocTagScope on the
+// allocating thread. JobSystem workers inherit the tag of the thread that
+// started the loop.
+enum class AllocTag { Other = 0, Solver = 1, Upload = 2, Ui = 3, Gl = 4 };
+inline constexpr int AllocTagCount = 5;
+
+// "other", "solver", "upload", "ui" or "gl".
+const char *AllocTagName(AllocTag tag);
+
+class AllocTagScope {
+public:
+  explicit AllocTagScope(AllocTag tag);
+  ~AllocTagScope();
+  AllocTagScope(const AllocTagScope &) = delete;
+  AllocTagScope &operator=(const AllocTagScope &) = delete;
+
+private:
+  AllocTag prev_;
+};
+
+AllocTag CurrentAllocTag();
+
+struct AllocCounts {
+  uint64_t allocs = 0, frees = 0, bytes = 0; // bytes requested
+};
+
+// Cumulative counts per tag since start-up; subtract two snapshots for a
+// frame's worth.
+struct AllocStats {
+  AllocCounts tags[AllocTagCount];
+
+  AllocCounts Total() const {
+    AllocCounts t;
+    for (const AllocCounts &c : tags) {
+      t.allocs += c.allocs;
+      t.frees += c.frees;
+      t.bytes += c.bytes;
+    }
+    return t;
+  }
+  AllocStats operator-(const AllocStats &o) const {
+    AllocStats d;
+    for (int i = 0; i < AllocTagCount; ++i) {
+      d.tags[i].allocs = tags[i].allocs - o.tags[i].allocs;
+      d.tags[i].frees = tags[i].frees - o.tags[i].frees;
+      d.tags[i].bytes = tags[i].bytes - o.tags[i].bytes;
+    }
+    return d;
+  }
+};
+
+// False when the hook is compiled out.
+bool AllocHookInstalled();
+// Sums the per-thread counters; they are not frozen while this runs.
+AllocStats ReadAllocStats();
+
+// Counts allocations made on tracked threads: any thread inside a
+// HeapCountScope, plus the JobSystem workers, which only ever run solver
+// loops. Used for the debug zero-allocation checks. Each thread counts in
+// its own block; the scope sums them.
+class HeapCountScope {
+public:
+  HeapCountScope();
+  ~HeapCountScope();
+  HeapCountScope(const HeapCountScope &) = delete;
+  HeapCountScope &operator=(const HeapCountScope &) = delete;
+
+  // Allocations on tracked threads since construction.
+  uint64_t GetCount() const;
+
+private:
+  uint64_t start_ = 0;
+  bool wasTracked_ = false;
+};
+
+// Marks the calling thread as tracked for the rest of its life.
+void TrackHeapAllocations();
@@ -0,0 +1,302 @@
+#include "ImageCodec.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+// Deflate bit order: values go out least significant bit first, Huffman
+// codes most significant bit first.
+struct BitWriter {
+  std::vector<uint8_t> &out;
+  uint64_t bits = 0;
+  int count = 0;
+
+  void Put(uint32_t v, int n) {
+    bits |= (uint64_t)v << count;
+    count += n;
+    while (count >= 8) {
+      out.push_back((uint8_t)bits);
+      bits >>= 8;
+      count -= 8;
+    }
+  }
+  void PutCode(uint32_t code, int n) {
+    uint32_t r = 0;
+    for (int i = 0; i < n; ++i)
+      r |= ((code >> i) & 1) << (n - 1 - i);
+    Put(r, n);
+  }
+  void Flush() {
+    if (count > 0)
+      out.push_back((uint8_t)bits);
+    bits = 0;
+    count = 0;
+  }
+};
+
+constexpr int lengthBase[29] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                                15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                                67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr int lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr int distBase[30] = {1,    2,    3,    4,     5,     7,    9,
+                              13,   17,   25,   33,    49,    65,   97,
+                              129,  193,  257,  385,   513,   769,  1025,
+                              1537, 2049, 3073, 4097,  6145,  8193, 12289,
+                              16385, 24577};
+constexpr int distExtra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                               4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                               9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Fixed literal/length code of RFC 1951 section 3.2.6.
+void PutSymbol(BitWriter &w, int sym) {
+  if (sym < 144)
+    w.PutCode(0x30 + sym, 8);
+  else if (sym < 256)
+    w.PutCode(0x190 + sym - 144, 9);
+  else if (sym < 280)
+    w.PutCode(sym - 256, 7);
+  else
+    w.PutCode(0xc0 + sym - 280, 8);
+}
+
+void PutMatch(BitWriter &w, int len, int dist) {
+  int l = (int)(std::upper_bound(lengthBase, lengthBase + 29, len) -
+                lengthBase) - 1;
+  PutSymbol(w, 257 + l);
+  w.Put(len - lengthBase[l], lengthExtra[l]);
+  int d = (int)(std::upper_bound(distBase, distBase + 30, dist) - distBase) -
+          1;
+  w.PutCode(d, 5);
+  w.Put(dist - distBase[d], distExtra[d]);
+}
+
+uint32_t Adler32(std::span<const uint8_t> in) {
+  uint32_t a = 1, b = 0;
+  size_t i = 0;
+  while (i < in.size()) {
+    // 5552 bytes is the most that cannot overflow b before the modulo.
+    size_t end = std::min(in.size(), i + 5552);
+    for (; i < end; ++i) {
+      a += in[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return b << 16 | a;
+}
+
+uint32_t Crc32(const uint8_t *p, size_t n, uint32_t crc = 0) {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> t;
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < n; ++i)
+    crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+void PutBe32(std::vector<uint8_t> &out, uint32_t v) {
+  out.insert(out.end(), {(uint8_t)(v >> 24), (uint8_t)(v >> 16),
+                         (uint8_t)(v >> 8), (uint8_t)v});
+}
+
+void PutChunk(std::vector<uint8_t> &out, const char type[4],
+              std::span<const uint8_t> data) {
+  PutBe32(out, (uint32_t)data.size());
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  PutBe32(out, Crc32(out.data() + start, out.size() - start));
+}
+
+uint8_t Paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+  return (uint8_t)(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+} // namespace
+
+void ZlibCompress(std::span<const uint8_t> in, std::vector<uint8_t> &out) {
+  constexpr int window = 32768, hashBits = 15, maxChain = 24;
+  constexpr int minLen = 3, maxLen = 258;
+  out.push_back(0x78); // deflate, 32 KiB window
+  out.push_back(0x01); // no dictionary, check bits
+  BitWriter w{out};
+  w.Put(1, 1); // final block
+  w.Put(1, 2); // fixed Huffman codes
+
+  const uint8_t *src = in.data();
+  int n = (int)in.size();
+  std::vector<int32_t> head(size_t(1) << hashBits, -1);
+  std::vector<int32_t> prev(window, -1);
+  auto hash = [&](int i) {
+    uint32_t v = src[i] | src[i + 1] << 8 | src[i + 2] << 16;
+    return (v * 2654435761u) >> (32 - hashBits);
+  };
+  auto insert = [&](int i) {
+    uint32_t h = hash(i);
+    prev[i & (window - 1)] = head[h];
+    head[h] = i;
+  };
+
+  int i = 0;
+  while (i < n) {
+    int best = 0, bestDist = 0;
+    if (i + minLen <= n) {
+      int limit = std::min(maxLen, n - i);
+      int cand = head[hash(i)];
+      for (int chain = maxChain; chain > 0 && cand >= 0 && i - cand <= window;
+           --chain) {
+        if (src[cand + best] == src[i + best]) {
+          int len = 0;
+          while (len < limit && src[cand + len] == src[i + len])
+            ++len;
+          if (len > best) {
+            best = len;
+            bestDist = i - cand;
+            if (len == limit)
+              break;
+          }
+        }
+        int next = prev[cand & (window - 1)];
+        if (next >= cand)
+          break;
+        cand = next;
+      }
+      insert(i);
+    }
+    if (best >= minLen) {
+      PutMatch(w, best, bestDist);
+      for (int k = 1; k < best; ++k)
+        if (i + k + minLen <= n)
+          insert(i + k);
+      i += best;
+    } else {
+      PutSymbol(w, src[i]);
+      ++i;
+    }
+  }
+  PutSymbol(w, 256); // end of block
+  w.Flush();
+  PutBe32(out, Adler32(in));
+}
+
+void EncodePng(const uint8_t *rgba, int width, int height, bool bottomUp,
+               std::vector<uint8_t> &out) {
+  // Each row gets the filter with the smallest sum of |residual|, the usual
+  // heuristic for picking one without trying to compress them all.
+  const int rowBytes = width * 3;
+  std::vector<uint8_t> rows((size_t)height * (rowBytes + 1));
+  std::vector<uint8_t> cur(rowBytes), up(rowBytes, 0);
+  std::vector<uint8_t> trial[4];
+  for (auto &t : trial)
+    t.resize(rowBytes);
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *src =
+        rgba + (size_t)(bottomUp ? height - 1 - y : y) * width * 4;
+    for (int x = 0; x < width; ++x)
+      for (int c = 0; c < 3; ++c)
+        cur[x * 3 + c] = src[x * 4 + c];
+
+    long bestCost = -1;
+    int bestFilter = 0;
+    const int filters[4] = {0, 1, 2, 4}; // none, sub, up, paeth
+    for (int f = 0; f < 4; ++f) {
+      long cost = 0;
+      for (int k = 0; k < rowBytes; ++k) {
+        int a = k >= 3 ? cur[k - 3] : 0, b = up[k];
+        int c = k >= 3 ? up[k - 3] : 0;
+        uint8_t pred = f == 0 ? 0 : f == 1 ? a : f == 2 ? b : Paeth(a, b, c);
+        uint8_t r = (uint8_t)(cur[k] - pred);
+        trial[f][k] = r;
+        cost += r < 128 ? r : 256 - r;
+      }
+      if (bestCost < 0 || cost < bestCost) {
+        bestCost = cost;
+        bestFilter = f;
+      }
+    }
+    uint8_t *dst = rows.data() + (size_t)y * (rowBytes + 1);
+    dst[0] = (uint8_t)filters[bestFilter];
+    std::copy(trial[bestFilter].begin(), trial[bestFilter].end(), dst + 1);
+    std::swap(up, cur);
+  }
+
+  out.clear();
+  const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  out.insert(out.end(), signature, signature + 8);
+  std::vector<uint8_t> ihdr;
+  PutBe32(ihdr, (uint32_t)width);
+  PutBe32(ihdr, (uint32_t)height);
+  ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0}); // 8-bit RGB, no interlace
+  PutChunk(out, "IHDR", ihdr);
+  std::vector<uint8_t> idat;
+  ZlibCompress(rows, idat);
+  PutChunk(out, "IDAT", idat);
+  PutChunk(out, "IEND", {});
+}
+
+void EncodePpm(const uint8_t *rgba, int width, int height, bool bottomUp,
+               std::vector<uint8_t> &out) {
+  char header[32];
+  int len = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width,
+                          height);
+  out.assign(header, header + len);
+  out.reserve(out.size() + (size_t)width * height * 3);
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *src =
+        rgba + (size_t)(bottomUp ? height - 1 - y : y) * width * 4;
+    for (int x = 0; x < width; ++x)
+      out.insert(out.end(), src + x * 4, src + x * 4 + 3);
+  }
+}
+
+void RgbaToI420(const uint8_t *rgba, int width, int height, bool bottomUp,
+                uint8_t *y, uint8_t *u, uint8_t *v) {
+  auto row = [&](int r) {
+    return rgba + (size_t)(bottomUp ? height - 1 - r : r) * width * 4;
+  };
+  for (int r = 0; r < height; ++r) {
+    const uint8_t *src = row(r);
+    uint8_t *dst = y + (size_t)r * width;
+    for (int x = 0; x < width; ++x) {
+      int R = src[x * 4], G = src[x * 4 + 1], B = src[x * 4 + 2];
+      dst[x] = (uint8_t)(((66 * R + 129 * G + 25 * B + 128) >> 8) + 16);
+    }
+  }
+
+  const int cw = (width + 1) / 2, ch = (height + 1) / 2;
+  const int pairs = width / 2; // columns with both pixels of a 2x2 block
+  for (int cy = 0; cy < ch; ++cy) {
+    const uint8_t *a = row(2 * cy);
+    const uint8_t *b = row(std::min(2 * cy + 1, height - 1));
+    uint8_t *du = u + (size_t)cy * cw, *dv = v + (size_t)cy * cw;
+    auto put = [&](int cx, int R, int G, int B) {
+      // R, G and B are sums of four pixels; the shift divides by 4 * 256.
+      du[cx] = (uint8_t)(((-38 * R - 74 * G + 112 * B + 512) >> 10) + 128);
+      dv[cx] = (uint8_t)(((112 * R - 94 * G - 18 * B + 512) >> 10) + 128);
+    };
+    for (int cx = 0; cx < pairs; ++cx) {
+      const uint8_t *p = a + cx * 8, *q = b + cx * 8;
+      put(cx, p[0] + p[4] + q[0] + q[4], p[1] + p[5] + q[1] + q[5],
+          p[2] + p[6] + q[2] + q[6]);
+    }
+    if (pairs < cw) {
+      const uint8_t *p = a + pairs * 8, *q = b + pairs * 8;
+      put(pairs, 2 * (p[0] + q[0]), 2 * (p[1] + q[1]), 2 * (p[2] + q[2]));
+    }
+  }
+}
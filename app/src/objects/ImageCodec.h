@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// zlib stream (RFC 1950/1951) in one fixed-Huffman deflate block, with a
+// hash-chain LZ77 matcher over the 32 KiB window. Output any inflater can
+// read, without depending on zlib.
+void ZlibCompress(std::span<const uint8_t> in, std::vector<uint8_t> &out);
+
+// 8-bit RGB images from RGBA8 pixels; alpha is dropped. bottomUp means the
+// first row in memory is the bottom one, as glReadPixels returns it. Both
+// replace the contents of `out`.
+void EncodePng(const uint8_t *rgba, int width, int height, bool bottomUp,
+               std::vector<uint8_t> &out);
+void EncodePpm(const uint8_t *rgba, int width, int height, bool bottomUp,
+               std::vector<uint8_t> &out);
+
+// BT.601 limited-range 4:2:0 planes from RGBA8 pixels, top row first: y is
+// width * height bytes, u and v (width + 1) / 2 * (height + 1) / 2 each.
+// Chroma is the rounded mean of each 2x2 block, so it is sited at the block
+// centre. Fixed-point arithmetic in plain loops the compiler vectorizes.
+void RgbaToI420(const uint8_t *rgba, int width, int height, bool bottomUp,
+                uint8_t *y, uint8_t *u, uint8_t *v);
@@ -0,0 +1,55 @@
+#include "ImageSequence.h"
+#include "ImageCodec.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+bool ImageSequenceWriter::Open(const std::string &dir,
+                               const std::string &prefix, ImageFormat format,
+                               int width, int height, int threads) {
+  Close();
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    std::cerr << "Cannot create " << dir << ": " << ec.message() << "\n";
+    return false;
+  }
+  dir_ = dir;
+  prefix_ = prefix;
+  format_ = format;
+  width_ = width;
+  height_ = height;
+  pool_.Open(
+      (size_t)width * height * 4, threads, false,
+      [this](const uint8_t *rgba, int, std::vector<uint8_t> &encoded) {
+        Encode(rgba, encoded);
+      },
+      [this](int frame, const std::vector<uint8_t> &encoded) {
+        return WriteImage(frame, encoded);
+      });
+  return true;
+}
+
+void ImageSequenceWriter::Encode(const uint8_t *rgba,
+                                 std::vector<uint8_t> &encoded) const {
+  if (format_ == ImageFormat::Png)
+    EncodePng(rgba, width_, height_, true, encoded);
+  else
+    EncodePpm(rgba, width_, height_, true, encoded);
+}
+
+bool ImageSequenceWriter::WriteImage(
+    int frame, const std::vector<uint8_t> &encoded) const {
+  char number[24];
+  std::snprintf(number, sizeof(number), "%06d.%s", frame,
+                ImageFormatName(format_));
+  std::filesystem::path path = std::filesystem::path(dir_) / (prefix_ + number);
+  std::ofstream f(path, std::ios::binary | std::ios::trunc);
+  f.write((const char *)encoded.data(), (std::streamsize)encoded.size());
+  if (!f) {
+    std::cerr << "Cannot write " << path.string() << "\n";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "FramePool.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class ImageFormat { Png = 0, Ppm = 1 };
+inline constexpr int ImageFormatCount = 2;
+
+inline const char *ImageFormatName(ImageFormat f) {
+  switch (f) {
+  case ImageFormat::Png:
+    return "png";
+  case ImageFormat::Ppm:
+    return "ppm";
+  }
+  return "?";
+}
+
+// Writes numbered frames (dir/<prefix>000000.png, ...) on a pool of encoder
+// threads (FramePool), so the caller can render the next frame while
+// earlier ones are compressed. Frames are RGBA8 with bottom-up rows, as
+// glReadPixels gives them.
+class ImageSequenceWriter {
+public:
+  ImageSequenceWriter() = default;
+  ~ImageSequenceWriter() { Close(); }
+  ImageSequenceWriter(const ImageSequenceWriter &) = delete;
+  ImageSequenceWriter &operator=(const ImageSequenceWriter &) = delete;
+
+  // Creates dir if needed. threads <= 0 uses all cores but one. Prints the
+  // reason and returns false on failure.
+  bool Open(const std::string &dir, const std::string &prefix,
+            ImageFormat format, int width, int height, int threads = 0);
+  // width * height * 4 bytes for the next frame.
+  uint8_t *BeginFrame() { return pool_.BeginFrame(); }
+  // Queues the buffer from BeginFrame() as the next frame in the sequence.
+  void SubmitFrame() { pool_.SubmitFrame(); }
+  // Waits for every queued frame. False if any file could not be written.
+  bool Close() { return pool_.Close(); }
+  bool IsOpen() const { return pool_.IsOpen(); }
+  FramePoolStats GetStats() { return pool_.GetStats(); }
+
+private:
+  void Encode(const uint8_t *rgba, std::vector<uint8_t> &encoded) const;
+  bool WriteImage(int frame, const std::vector<uint8_t> &encoded) const;
+
+  std::string dir_;
+  std::string prefix_;
+  ImageFormat format_ = ImageFormat::Png;
+  int width_ = 0, height_ = 0;
+  FramePool pool_;
+};
@@ -0,0 +1,162 @@
+#include "InitialConditions.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+const char *InitShapeName(InitShape s) {
+  switch (s) {
+  case InitShape::DamBreak:
+    return "dambreak";
+  case InitShape::FilledBox:
+    return "box";
+  case InitShape::Lattice:
+    return "lattice";
+  case InitShape::JitteredGrid:
+    return "jitter";
+  case InitShape::PoissonDisk:
+    return "poisson";
+  }
+  return "?";
+}
+
+bool ParseInitShape(const char *name, InitShape &out) {
+  for (int i = 0; i <= (int)InitShape::PoissonDisk; ++i) {
+    if (!std::strcmp(name, InitShapeName((InitShape)i))) {
+      out = (InitShape)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint32_t Hash(uint32_t a, uint32_t b) {
+  uint32_t h = a * 0x9E3779B1u ^ (b + 0x7F4A7C15u + (a << 6) + (a >> 2));
+  h ^= h >> 16;
+  h *= 0x85EBCA6Bu;
+  h ^= h >> 13;
+  return h;
+}
+
+// Square, hexagonal or jittered lattice: one slot per site, rows in parallel,
+// then an ordered compaction.
+static std::vector<glm::vec2>
+GenerateLattice(const InitRequest &req,
+                const std::function<bool(glm::vec2)> &inside) {
+  const bool hex = req.shape == InitShape::Lattice;
+  const bool jitter = req.shape == InitShape::JitteredGrid;
+  const float dx = req.spacing;
+  const float dy = hex ? req.spacing * 0.8660254f : req.spacing;
+  glm::vec2 ext = req.max - req.min;
+  int cols = std::max(1, (int)std::floor(ext.x / dx));
+  int rows = std::max(1, (int)std::floor(ext.y / dy));
+
+  std::vector<glm::vec2> slots((size_t)rows * cols);
+  std::vector<uint8_t> valid((size_t)rows * cols, 0);
+  glm::vec2 origin = req.min + glm::vec2(dx, dy) * 0.5f;
+
+  JobSystem::Get().ParallelFor(rows, 4, [&](int r0, int r1) {
+    for (int r = r0; r < r1; ++r) {
+      std::mt19937 rng(Hash(req.seed, (uint32_t)r));
+      std::uniform_real_distribution<float> j(-0.25f, 0.25f);
+      float shift = (hex && (r & 1)) ? 0.5f * dx : 0.0f;
+      for (int c = 0; c < cols; ++c) {
+        glm::vec2 p = origin + glm::vec2(c * dx + shift, r * dy);
+        if (jitter)
+          p += glm::vec2(j(rng), j(rng)) * req.spacing;
+        size_t k = (size_t)r * cols + c;
+        slots[k] = p;
+        valid[k] = (p.x < req.max.x && inside(p)) ? 1 : 0;
+      }
+    }
+  });
+
+  std::vector<glm::vec2> out;
+  out.reserve(std::min<size_t>(slots.size(), req.maxCount));
+  for (size_t k = 0; k < slots.size() && (int)out.size() < req.maxCount; ++k)
+    if (valid[k])
+      out.push_back(slots[k]);
+  return out;
+}
+
+// Dart throwing on a background grid (cell = r / sqrt 2, at most one point
+// per cell). Tiles of 4x4 cells are processed in four 2x2-coloured phases:
+// same-coloured tiles are a full tile (> r) apart, so tiles of one phase
+// never conflict and can run in parallel without locks.
+static std::vector<glm::vec2>
+GeneratePoisson(const InitRequest &req,
+                const std::function<bool(glm::vec2)> &inside) {
+  const float r = req.spacing;
+  const float cell = r / std::sqrt(2.0f);
+  const int tileCells = 4;
+  glm::vec2 ext = req.max - req.min;
+  int gx = std::max(1, (int)std::ceil(ext.x / cell));
+  int gy = std::max(1, (int)std::ceil(ext.y / cell));
+  int tx = (gx + tileCells - 1) / tileCells;
+  int ty = (gy + tileCells - 1) / tileCells;
+
+  std::vector<glm::vec2> pts((size_t)gx * gy);
+  std::vector<uint8_t> used((size_t)gx * gy, 0);
+
+  auto fits = [&](glm::vec2 p, int cx, int cy) {
+    for (int y = std::max(cy - 2, 0); y <= std::min(cy + 2, gy - 1); ++y)
+      for (int x = std::max(cx - 2, 0); x <= std::min(cx + 2, gx - 1); ++x) {
+        size_t k = (size_t)y * gx + x;
+        if (used[k]) {
+          glm::vec2 d = pts[k] - p;
+          if (glm::dot(d, d) < r * r)
+            return false;
+        }
+      }
+    return true;
+  };
+
+  const int attemptsPerCell = 8;
+  for (int phase = 0; phase < 4; ++phase) {
+    int px = phase & 1, py = phase >> 1;
+    int ptx = (tx - px + 1) / 2, pty = (ty - py + 1) / 2;
+    JobSystem::Get().ParallelFor(ptx * pty, 1, [&](int t0, int t1) {
+      for (int t = t0; t < t1; ++t) {
+        int tileX = (t % ptx) * 2 + px, tileY = (t / ptx) * 2 + py;
+        int cx0 = tileX * tileCells, cy0 = tileY * tileCells;
+        int cx1 = std::min(cx0 + tileCells, gx);
+        int cy1 = std::min(cy0 + tileCells, gy);
+        std::mt19937 rng(Hash(req.seed, (uint32_t)(tileY * tx + tileX)));
+        std::uniform_real_distribution<float> u(0.0f, 1.0f);
+        int attempts = attemptsPerCell * (cx1 - cx0) * (cy1 - cy0);
+        for (int a = 0; a < attempts; ++a) {
+          glm::vec2 p =
+              req.min + glm::vec2(cx0 + u(rng) * (cx1 - cx0),
+                                  cy0 + u(rng) * (cy1 - cy0)) *
+                            cell;
+          int cx = std::min((int)((p.x - req.min.x) / cell), gx - 1);
+          int cy = std::min((int)((p.y - req.min.y) / cell), gy - 1);
+          size_t k = (size_t)cy * gx + cx;
+          if (used[k] || p.x > req.max.x || p.y > req.max.y)
+            continue;
+          if (!fits(p, cx, cy) || !inside(p))
+            continue;
+          pts[k] = p;
+          used[k] = 1;
+        }
+      }
+    });
+  }
+
+  std::vector<glm::vec2> out;
+  for (size_t k = 0; k < pts.size() && (int)out.size() < req.maxCount; ++k)
+    if (used[k])
+      out.push_back(pts[k]);
+  return out;
+}
+
+std::vector<glm::vec2>
+GenerateInitialPositions(const InitRequest &req,
+                         const std::function<bool(glm::vec2)> &inside) {
+  if (req.maxCount <= 0 || req.spacing <= 0.0f)
+    return {};
+  if (req.shape == InitShape::PoissonDisk)
+    return GeneratePoisson(req, inside);
+  return GenerateLattice(req, inside);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <vector>
+
+enum class InitShape {
+  DamBreak = 0,
+  FilledBox,
+  Lattice,
+  JitteredGrid,
+  PoissonDisk
+};
+
+const char *InitShapeName(InitShape s);
+bool ParseInitShape(const char *name, InitShape &out);
+
+struct InitRequest {
+  InitShape shape = InitShape::DamBreak;
+  glm::vec2 min = {0.0f, 0.0f}; // sampling window
+  glm::vec2 max = {0.0f, 0.0f};
+  float spacing = 0.04f; // lattice pitch / Poisson minimum distance
+  int maxCount = 0;
+  uint32_t seed = 1;
+};
+
+// Fills the window bottom-up with up to maxCount points for which inside()
+// holds. Rows (or Poisson tiles) are generated in parallel on the job
+// system; the output order depends only on the request, not on the thread
+// count.
+std::vector<glm::vec2>
+GenerateInitialPositions(const InitRequest &req,
+                         const std::function<bool(glm::vec2)> &inside);
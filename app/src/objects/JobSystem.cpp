@@ -0,0 +1,135 @@
+#include "JobSystem.h"
+#include <algorithm>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static int CurrentThreadId() {
+#ifdef __linux__
+  return (int)syscall(SYS_gettid);
+#else
+  return -1;
+#endif
+}
+
+JobSystem &JobSystem::Get() {
+  static JobSystem pool(
+      (int)std::max(1u, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+JobSystem::JobSystem(int threads) { StartWorkers(threads - 1); }
+
+JobSystem::~JobSystem() { StopWorkers(); }
+
+void JobSystem::SetThreadCount(int threads) {
+  threads = std::max(threads, 1);
+  if (threads == GetThreadCount())
+    return;
+  StopWorkers();
+  StartWorkers(threads - 1);
+}
+
+std::vector<int> JobSystem::GetThreadIds() {
+  std::vector<int> ids;
+  if (CurrentThreadId() < 0)
+    return ids;
+  ids.push_back(CurrentThreadId());
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (int id : threadIds_)
+    if (id >= 0)
+      ids.push_back(id);
+  return ids;
+}
+
+void JobSystem::StartWorkers(int count) {
+  quit_ = false;
+  threadIds_.assign(count, -1);
+  for (int i = 0; i < count; ++i)
+    workers_.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+void JobSystem::StopWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  wake_.notify_all();
+  for (auto &t : workers_)
+    t.join();
+  workers_.clear();
+  threadIds_.clear();
+  threadIdsVersion_.fetch_add(1, std::memory_order_release);
+}
+
+void JobSystem::RunChunks() {
+  for (;;) {
+    int c = nextChunk_.fetch_add(1, std::memory_order_relaxed);
+    if (c >= chunks_)
+      break;
+    int b = c * grain_;
+    fn_(ctx_, b, std::min(b + grain_, count_));
+    if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_.notify_all();
+    }
+  }
+}
+
+void JobSystem::Run(int count, int grain, ChunkFn fn, void *ctx) {
+  {
+    // Job fields are read without the lock, so wait until no straggler from
+    // the previous job is still inside RunChunks.
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return active_ == 0; });
+    fn_ = fn;
+    ctx_ = ctx;
+    count_ = count;
+    grain_ = grain;
+    chunks_ = (count + grain - 1) / grain;
+    tag_ = CurrentAllocTag();
+    nextChunk_.store(0, std::memory_order_relaxed);
+    pending_.store(chunks_, std::memory_order_relaxed);
+    ++generation_;
+  }
+  wake_.notify_all();
+  RunChunks();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] {
+    return pending_.load(std::memory_order_acquire) == 0 && active_ == 0;
+  });
+  fn_ = nullptr;
+}
+
+void JobSystem::WorkerLoop(int index) {
+  TrackHeapAllocations();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threadIds_[index] = CurrentThreadId();
+    threadIdsVersion_.fetch_add(1, std::memory_order_release);
+  }
+  unsigned seen = 0;
+  for (;;) {
+    AllocTag tag;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [&] { return quit_ || generation_ != seen; });
+      if (quit_)
+        return;
+      seen = generation_;
+      tag = tag_;
+      ++active_;
+    }
+    {
+      AllocTagScope scope(tag);
+      RunChunks();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--active_ == 0)
+        done_.notify_all();
+    }
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "HeapCounter.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Persistent worker pool for data-parallel loops. ParallelFor splits
+// [0, count) into fixed `grain`-sized chunks; chunk boundaries depend only
+// on count and grain, never on the number of threads. The calling thread
+// takes part in the work. Not re-entrant: one loop runs at a time.
+class JobSystem {
+public:
+  static JobSystem &Get();
+
+  explicit JobSystem(int threads);
+  ~JobSystem();
+
+  // Total threads including the caller; 1 runs everything inline.
+  void SetThreadCount(int threads);
+  int GetThreadCount() const { return (int)workers_.size() + 1; }
+  // OS thread ids of the calling thread and every started worker, for
+  // per-thread hardware counters. Empty where the OS has no such ids.
+  std::vector<int> GetThreadIds();
+  // Changes whenever GetThreadIds() would return a different set.
+  unsigned GetThreadIdsVersion() const {
+    return threadIdsVersion_.load(std::memory_order_acquire);
+  }
+
+  template <typename Fn> void ParallelFor(int count, int grain, Fn &&fn);
+
+private:
+  using ChunkFn = void (*)(void *ctx, int begin, int end);
+
+  void Run(int count, int grain, ChunkFn fn, void *ctx);
+  void RunChunks();
+  void WorkerLoop(int index);
+  void StartWorkers(int count);
+  void StopWorkers();
+
+  std::vector<std::thread> workers_;
+  std::vector<int> threadIds_; // per worker, -1 until it has started
+  std::atomic<unsigned> threadIdsVersion_{0};
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  bool quit_ = false;
+  unsigned generation_ = 0;
+  int active_ = 0; // workers inside RunChunks, guarded by mutex_
+
+  // current job
+  ChunkFn fn_ = nullptr;
+  void *ctx_ = nullptr;
+  int count_ = 0, grain_ = 1, chunks_ = 0;
+  AllocTag tag_ = AllocTag::Other; // the caller's, for the workers
+  std::atomic<int> nextChunk_{0};
+  std::atomic<int> pending_{0};
+};
+
+template <typename Fn>
+void JobSystem::ParallelFor(int count, int grain, Fn &&fn) {
+  if (count <= 0)
+    return;
+  grain = grain < 1 ? 1 : grain;
+  if (workers_.empty() || count <= grain) {
+    for (int b = 0; b < count; b += grain)
+      fn(b, b + grain < count ? b + grain : count);
+    return;
+  }
+  using F = std::remove_reference_t<Fn>;
+  Run(count, grain,
+      [](void *ctx, int b, int e) { (*static_cast<F *>(ctx))(b, e); },
+      (void *)&fn);
+}
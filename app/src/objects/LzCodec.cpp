@@ -0,0 +1,115 @@
+#include "LzCodec.h"
+#include <cstring>
+
+static constexpr size_t minMatch = 4;
+static constexpr size_t maxOffset = 65535;
+// The last bytes are always literals, so the match search can read four
+// bytes ahead without a bounds check.
+static constexpr size_t tailLiterals = 5;
+
+static uint32_t Read32(const uint8_t *p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof v);
+  return v;
+}
+
+static void PutLength(std::vector<uint8_t> &out, size_t len) {
+  for (; len >= 255; len -= 255)
+    out.push_back(255);
+  out.push_back((uint8_t)len);
+}
+
+static void PutSequence(std::vector<uint8_t> &out, const uint8_t *lit,
+                        size_t litLen, size_t offset, size_t matchLen) {
+  size_t m = matchLen ? matchLen - minMatch : 0;
+  out.push_back((uint8_t)((litLen < 15 ? litLen : 15) << 4 |
+                          (m < 15 ? m : 15)));
+  if (litLen >= 15)
+    PutLength(out, litLen - 15);
+  out.insert(out.end(), lit, lit + litLen);
+  if (!matchLen)
+    return;
+  out.push_back((uint8_t)(offset & 0xff));
+  out.push_back((uint8_t)(offset >> 8));
+  if (m >= 15)
+    PutLength(out, m - 15);
+}
+
+LzEncoder::LzEncoder() : table_(new uint32_t[size_t(1) << hashBits_]) {}
+
+void LzEncoder::Compress(std::span<const uint8_t> in,
+                         std::vector<uint8_t> &out) {
+  const uint8_t *src = in.data();
+  size_t n = in.size();
+  size_t anchor = 0;
+  if (n > minMatch + tailLiterals) {
+    std::memset(table_.get(), 0, sizeof(uint32_t) << hashBits_);
+    size_t limit = n - tailLiterals;
+    size_t i = 0;
+    while (i + minMatch <= limit) {
+      uint32_t v = Read32(src + i);
+      uint32_t h = (v * 2654435761u) >> (32 - hashBits_);
+      size_t cand = table_[h];
+      table_[h] = (uint32_t)(i + 1);
+      if (cand && i + 1 - cand <= maxOffset && Read32(src + cand - 1) == v) {
+        size_t from = cand - 1;
+        size_t len = minMatch;
+        while (i + len < limit && src[from + len] == src[i + len])
+          ++len;
+        PutSequence(out, src + anchor, i - anchor, i - from, len);
+        i += len;
+        anchor = i;
+      } else {
+        // Step faster the longer nothing has matched.
+        i += 1 + ((i - anchor) >> 6);
+      }
+    }
+  }
+  PutSequence(out, src + anchor, n - anchor, 0, 0);
+}
+
+static bool GetLength(const uint8_t *&p, const uint8_t *end, size_t &len) {
+  for (;;) {
+    if (p == end)
+      return false;
+    uint8_t b = *p++;
+    len += b;
+    if (b != 255)
+      return true;
+  }
+}
+
+bool LzDecompress(std::span<const uint8_t> in, std::span<uint8_t> out) {
+  const uint8_t *p = in.data(), *end = p + in.size();
+  uint8_t *dst = out.data();
+  size_t at = 0, n = out.size();
+  while (p < end) {
+    uint8_t token = *p++;
+    size_t lit = token >> 4;
+    if (lit == 15 && !GetLength(p, end, lit))
+      return false;
+    if (lit > (size_t)(end - p) || lit > n - at)
+      return false;
+    std::memcpy(dst + at, p, lit);
+    p += lit;
+    at += lit;
+    if (p == end)
+      break; // the last sequence has no match
+    if (end - p < 2)
+      return false;
+    size_t offset = p[0] | (size_t)p[1] << 8;
+    p += 2;
+    size_t len = token & 15;
+    if (len == 15 && !GetLength(p, end, len))
+      return false;
+    len += minMatch;
+    if (offset == 0 || offset > at || len > n - at)
+      return false;
+    // Byte by byte: the source may overlap what is being written.
+    const uint8_t *from = dst + at - offset;
+    for (size_t k = 0; k < len; ++k)
+      dst[at + k] = from[k];
+    at += len;
+  }
+  return at == n;
+}
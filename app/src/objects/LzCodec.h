@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Byte-oriented LZ77 in the style of the LZ4 block format: each sequence
+// is a token (literal run length, match length - 4), the literals, and a
+// 16-bit back-reference offset; lengths of 15 or more continue in 255-run
+// bytes. Matches are found through a hash of the next four bytes, and the
+// search stride grows over incompressible stretches. Meant for data that
+// already went through a delta/varint stage, which does the entropy work.
+class LzEncoder {
+public:
+  LzEncoder();
+
+  // Appends the compressed form of `in` to `out`.
+  void Compress(std::span<const uint8_t> in, std::vector<uint8_t> &out);
+
+  // Upper bound on the compressed size of n bytes.
+  static size_t Bound(size_t n) { return n + n / 255 + 16; }
+
+private:
+  static constexpr int hashBits_ = 14;
+  std::unique_ptr<uint32_t[]> table_; // hash -> position + 1, 0 = empty
+};
+
+// Fills `out` exactly; false on malformed input.
+bool LzDecompress(std::span<const uint8_t> in, std::span<uint8_t> out);
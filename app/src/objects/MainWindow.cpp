@@ -1,5 +1,6 @@
 #include "MainWindow.h"
 #include <algorithm>
+#include <cstdio>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
@@ -36,6 +37,52 @@ void MainWindow::setRenderTexture(uint32_t glTexId, int width, int height) {
     texHeight_ = height;
 }
 
+void MainWindow::setCheckpointPath(const std::string &path) {
+  std::snprintf(checkpointPath_, sizeof(checkpointPath_), "%s", path.c_str());
+}
+
+void MainWindow::setRecordPath(const std::string &path) {
+  std::snprintf(recordPath_, sizeof(recordPath_), "%s", path.c_str());
+}
+
+void MainWindow::setPlayback(const TrajectoryPlayer &player) {
+  playback_ = player.IsOpen();
+  playbackPlaying_ = player.GetPlaying();
+  playbackLoop_ = player.GetLoop();
+  playbackSpeed_ = player.GetSpeed();
+  playbackTime_ = (float)player.GetTime();
+  playbackStart_ = (float)player.GetStartTime();
+  playbackEnd_ = (float)player.GetEndTime();
+  playbackFrame_ = player.GetFrame();
+  playbackFrames_ = player.GetFrameCount();
+}
+
+void MainWindow::setFrameAllocations(const AllocStats &frame) {
+  allocFrame_ = frame;
+  for (int t = 0; t < AllocTagCount; ++t)
+    allocPeak_[t] = std::max(allocPeak_[t], frame.tags[t].allocs);
+}
+
+void MainWindow::setPerfCounters(bool on, const std::string &error,
+                                 const PhaseCounters &total) {
+  perfCounters_ = on;
+  if (perfError_ != error)
+    perfError_ = error;
+  if (!on || total.steps < perfMark_.steps) { // off, or restarted
+    perfMark_ = perfShown_ = {};
+    return;
+  }
+  if (total.steps - perfMark_.steps < perfWindow_)
+    return;
+  perfShown_ = total;
+  for (int p = 0; p < SolverPhaseCount; ++p)
+    for (int e = 0; e < PerfEventCount; ++e)
+      perfShown_.phases[p].v[e] -= perfMark_.phases[p].v[e];
+  perfShown_.particles -= perfMark_.particles;
+  perfShown_.steps -= perfMark_.steps;
+  perfMark_ = total;
+}
+
 void MainWindow::Render(int particleCount) {
   int w, h;
   glfwGetFramebufferSize(window_, &w, &h);
@@ -70,7 +117,7 @@ void MainWindow::Render(int particleCount) {
 
   ImGui::Separator();
 
-  ImGui::Text("Particles: %d", particleCount);
+  ImGui::Text("Particles: %d / %d", particleCount, capacity_);
   ImGui::SameLine(160);
   if (!running_) {
     if (ImGui::Button("  Start  ")) {
@@ -93,6 +140,90 @@ void MainWindow::Render(int particleCount) {
   ImGui::SameLine();
   ImGui::TextDisabled(running_ ? "[running]" : "[paused]");
 
+  if (ImGui::Button("Save state") && onSaveCheckpoint_)
+    onSaveCheckpoint_(checkpointPath_);
+  ImGui::SameLine();
+  if (ImGui::Button("Load state") && onLoadCheckpoint_)
+    onLoadCheckpoint_(checkpointPath_);
+  ImGui::SameLine();
+  ImGui::PushItemWidth(240.f);
+  ImGui::InputText("Checkpoint file", checkpointPath_,
+                   sizeof(checkpointPath_));
+  ImGui::PopItemWidth();
+  if (ImGui::Button(recording_ ? "Stop rec" : " Record ") && onRecordChanged_)
+    onRecordChanged_(!recording_, recordPath_);
+  ImGui::SameLine();
+  ImGui::PushItemWidth(240.f);
+  ImGui::InputText("Trajectory file", recordPath_, sizeof(recordPath_));
+  ImGui::PopItemWidth();
+  if (recording_) {
+    const TrajectoryStats &r = recordStats_;
+    ImGui::TextDisabled("Recorded %llu frames, %.1f MiB (%.1fx), %llu stalls",
+                        (unsigned long long)r.frames,
+                        r.fileBytes / (1024.0 * 1024.0), r.Ratio(),
+                        (unsigned long long)r.stalls);
+  }
+  if (ImGui::Button(playback_ ? "  Live  " : "  Play  ") &&
+      onPlaybackChanged_)
+    onPlaybackChanged_(!playback_, recordPath_);
+  if (playback_) {
+    ImGui::SameLine();
+    if (ImGui::Button(playbackPlaying_ ? "Pause" : "Resume") &&
+        onPlaybackPlayingChanged_)
+      onPlaybackPlayingChanged_(!playbackPlaying_);
+    ImGui::SameLine();
+    if (ImGui::Button("<") && onPlaybackStep_)
+      onPlaybackStep_(-1);
+    ImGui::SameLine();
+    if (ImGui::Button(">") && onPlaybackStep_)
+      onPlaybackStep_(1);
+    ImGui::SameLine();
+    if (ImGui::Checkbox("Loop", &playbackLoop_) && onPlaybackLoopChanged_)
+      onPlaybackLoopChanged_(playbackLoop_);
+    ImGui::SameLine();
+    float prevSpeed = playbackSpeed_;
+    ImGui::PushItemWidth(160.f);
+    ImGui::SliderFloat("Speed", &playbackSpeed_, 0.05f, 16.0f, "%.2fx",
+                       ImGuiSliderFlags_Logarithmic);
+    ImGui::PopItemWidth();
+    if (playbackSpeed_ != prevSpeed && onPlaybackSpeedChanged_)
+      onPlaybackSpeedChanged_(playbackSpeed_);
+
+    // Dragging the timeline scrubs: every change seeks.
+    float prevTime = playbackTime_;
+    ImGui::PushItemWidth(-160.f);
+    ImGui::SliderFloat("##timeline", &playbackTime_, playbackStart_,
+                       playbackEnd_, "%.2f s");
+    ImGui::PopItemWidth();
+    if (playbackTime_ != prevTime && onPlaybackSeek_)
+      onPlaybackSeek_(playbackTime_);
+    ImGui::SameLine();
+    ImGui::Text("frame %d / %d", playbackFrame_ + 1, playbackFrames_);
+  }
+
+  if (ImGui::Button("Screenshot") && onScreenshot_)
+    onScreenshot_(captureDir_);
+  ImGui::SameLine();
+  if (ImGui::Button(capturing_ ? "Stop capture" : "  Capture   ") &&
+      onCaptureChanged_)
+    onCaptureChanged_(!capturing_, captureDir_);
+  ImGui::SameLine();
+  ImGui::PushItemWidth(240.f);
+  ImGui::InputText("Capture folder", captureDir_, sizeof(captureDir_));
+  ImGui::PopItemWidth();
+  if (captureStats_.queued > 0) {
+    const FrameCaptureStats &c = captureStats_;
+    ImGui::TextDisabled("Captured %llu / %llu frames, %.1f MiB, %d in flight, "
+                        "%llu GPU waits, %llu encoder stalls",
+                        (unsigned long long)c.written,
+                        (unsigned long long)c.queued,
+                        c.bytes / (1024.0 * 1024.0), c.inFlight,
+                        (unsigned long long)c.gpuWaits,
+                        (unsigned long long)c.encoderStalls);
+  }
+  if (drained_ > 0)
+    ImGui::TextDisabled("Drained by sinks: %d", drained_);
+
   ImGui::Spacing();
   ImGui::Separator();
   ImGui::Text("Fluid Properties");
@@ -113,6 +244,14 @@ void MainWindow::Render(int particleCount) {
   if (viscosity_ != prevV && onViscosityChanged_)
     onViscosityChanged_(viscosity_);
 
+  float prevK = stiffness_;
+  ImGui::PushItemWidth(160.f);
+  ImGui::SliderFloat("Stiffness", &stiffness_, 1.0f, 200.0f, "%.0f",
+                     ImGuiSliderFlags_Logarithmic);
+  ImGui::PopItemWidth();
+  if (stiffness_ != prevK && onStiffnessChanged_)
+    onStiffnessChanged_(stiffness_);
+
   int prevQ = quality_;
   ImGui::PushItemWidth(160.f);
   ImGui::SliderInt("Quality (flow rate)", &quality_, 1, 10);
@@ -122,6 +261,32 @@ void MainWindow::Render(int particleCount) {
   if (quality_ != prevQ && onQualityChanged_)
     onQualityChanged_(quality_);
 
+  ImGui::PushItemWidth(160.f);
+  ImGui::InputInt("Capacity", &capacityEdit_, 100, 10000);
+  ImGui::PopItemWidth();
+  capacityEdit_ = std::clamp(capacityEdit_, 1, 10000000);
+  ImGui::SameLine();
+  if (ImGui::Button("Apply") && capacityEdit_ != capacity_) {
+    capacity_ = capacityEdit_;
+    if (onCapacityChanged_)
+      onCapacityChanged_(capacity_);
+  }
+  ImGui::SameLine();
+  ImGui::TextDisabled("CPU %.1f MiB, GPU %.1f MiB",
+                      cpuBytes_ / (1024.0 * 1024.0),
+                      gpuBytes_ / (1024.0 * 1024.0));
+
+  ImGui::PushItemWidth(160.f);
+  ImGui::Combo("Initial block", &initShape_,
+               "Dam break\0Filled box\0Lattice\0Jittered grid\0"
+               "Poisson disk\0");
+  ImGui::InputInt("Block particles", &initCount_, 1000, 10000);
+  ImGui::PopItemWidth();
+  initCount_ = std::clamp(initCount_, 1, 10000000);
+  ImGui::SameLine();
+  if (ImGui::Button("Generate") && onGenerate_)
+    onGenerate_(initShape_, initCount_);
+
   float prevRad = renderRadius_;
   ImGui::PushItemWidth(160.f);
   ImGui::SliderFloat("Particle size", &renderRadius_, 0.022f, 0.05f, "%.3f");
@@ -137,6 +302,91 @@ void MainWindow::Render(int particleCount) {
     onColorChanged_(color_[0], color_[1], color_[2]);
   }
 
+  int prevMode = renderMode_;
+  ImGui::PushItemWidth(160.f);
+  ImGui::Combo("Particle shape", &renderMode_,
+               "Triangle fan\0Quad (SDF)\0Point sprite\0");
+  ImGui::PopItemWidth();
+  if (renderMode_ != prevMode && onRenderModeChanged_)
+    onRenderModeChanged_(renderMode_);
+
+  int prevBoundary = boundaryMode_;
+  ImGui::PushItemWidth(160.f);
+  ImGui::Combo("Boundary", &boundaryMode_, "SDF lookup\0Exact (BVH)\0");
+  ImGui::PopItemWidth();
+  if (boundaryMode_ != prevBoundary && onBoundaryModeChanged_)
+    onBoundaryModeChanged_(boundaryMode_);
+
+  int prevCollision = collisionMode_;
+  ImGui::PushItemWidth(160.f);
+  ImGui::Combo("Collisions", &collisionMode_,
+               "Gauss-Seidel\0Jacobi (parallel)\0");
+  ImGui::PopItemWidth();
+  if (collisionMode_ != prevCollision && onCollisionModeChanged_)
+    onCollisionModeChanged_(collisionMode_);
+
+  int prevKernel = kernel_;
+  ImGui::PushItemWidth(160.f);
+  ImGui::Combo("Kernel", &kernel_, "Mueller (Poly6/Spiky)\0Wendland C2\0"
+                                   "Cubic spline\0");
+  ImGui::PopItemWidth();
+  if (kernel_ != prevKernel && onKernelChanged_)
+    onKernelChanged_(kernel_);
+
+  int prevPrecision = precision_;
+  ImGui::PushItemWidth(160.f);
+  ImGui::Combo("Sum precision", &precision_, "Float\0Double\0");
+  ImGui::PopItemWidth();
+  if (precision_ != prevPrecision && onPrecisionChanged_)
+    onPrecisionChanged_(precision_);
+
+  if (ImGui::Checkbox("Boundary particles", &boundaryParticles_) &&
+      onBoundaryParticlesChanged_)
+    onBoundaryParticlesChanged_(boundaryParticles_);
+
+  if (ImGui::Checkbox("Sleep settled cells", &sleeping_) && onSleepingChanged_)
+    onSleepingChanged_(sleeping_);
+  ImGui::SameLine();
+  ImGui::TextDisabled("%d sleeping / %d active", sleepingCount_,
+                      particleCount - sleepingCount_);
+
+  if (ImGui::Checkbox("Multi-rate substeps", &multiRate_) &&
+      onMultiRateChanged_)
+    onMultiRateChanged_(multiRate_);
+  ImGui::SameLine();
+  ImGui::TextDisabled("1x %d / 2x %d / 4x %d", levelCounts_[0],
+                      levelCounts_[1], levelCounts_[2]);
+
+  if (ImGui::Checkbox("Hardware counters", &perfCounters_) &&
+      onPerfCountersChanged_)
+    onPerfCountersChanged_(perfCounters_);
+  if (!perfError_.empty()) {
+    ImGui::SameLine();
+    ImGui::TextDisabled("%s", perfError_.c_str());
+  }
+  // With an error but counters on, some threads opened and are shown.
+  if (perfCounters_ && perfShown_.steps > 0) {
+    const PhaseCounters &c = perfShown_;
+    ImGui::TextDisabled("%-12s %9s %5s %7s %7s %7s", "per particle",
+                        "cycles", "IPC", "L1d", "LLC", "br miss");
+    for (int p = 0; p <= SolverPhaseCount; ++p) {
+      PerfSample s = p < SolverPhaseCount ? c.phases[p] : c.Sum();
+      const char *name =
+          p < SolverPhaseCount ? SolverPhaseName((SolverPhase)p) : "total";
+      // Events the CPU would not count read -1.
+      auto per = [&](PerfEvent e) {
+        return c.Has(e) ? c.PerParticle(s, e) : -1.0;
+      };
+      ImGui::TextDisabled("%-12s %9.0f %5.2f %7.3f %7.3f %7.3f", name,
+                          per(PerfEvent::Cycles),
+                          c.Has(PerfEvent::Instructions)
+                              ? PhaseCounters::Ipc(s)
+                              : -1.0,
+                          per(PerfEvent::L1dMisses), per(PerfEvent::LlcMisses),
+                          per(PerfEvent::BranchMisses));
+    }
+  }
+
   ImGui::Spacing();
 
   if (ImGui::Checkbox("Dark mode", &themeDark_)) {
@@ -148,8 +398,30 @@ void MainWindow::Render(int particleCount) {
 
   ImGui::Spacing();
   ImGui::Separator();
-  ImGui::TextDisabled("Teal rectangle = fluid source");
-  ImGui::TextDisabled("Gray triangle  = obstacle / ramp");
+  ImGui::TextDisabled("Teal rectangles = fluid emitters");
+  ImGui::TextDisabled("Red rectangles  = sinks");
+  ImGui::TextDisabled("Gray shapes    = obstacles / walls");
+  ImGui::TextDisabled("Scene: %s (%d segments, %d emitters)",
+                      sceneName_.c_str(), sceneSegments_, sceneEmitters_);
+  ImGui::TextDisabled("Solver path: %s (CPU supports %s)",
+                      solverPath_.c_str(), cpuIsa_.c_str());
+  if (AllocHookInstalled()) {
+    AllocCounts total = allocFrame_.Total();
+    ImGui::TextDisabled("Heap per frame: %llu allocs, %llu frees, %.1f KiB",
+                        (unsigned long long)total.allocs,
+                        (unsigned long long)total.frees,
+                        total.bytes / 1024.0);
+    for (int t = 0; t < AllocTagCount; ++t) {
+      const AllocCounts &c = allocFrame_.tags[t];
+      ImGui::TextDisabled("  %-6s %5llu allocs %8.1f KiB  peak %llu",
+                          AllocTagName((AllocTag)t),
+                          (unsigned long long)c.allocs, c.bytes / 1024.0,
+                          (unsigned long long)allocPeak_[t]);
+    }
+  } else {
+    ImGui::TextDisabled("Heap per frame: not counted (release build "
+                        "without FLUID_ALLOC_HOOK)");
+  }
 
   ImGui::End();
   ImGui::Render();
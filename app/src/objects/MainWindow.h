@@ -1,7 +1,13 @@
 #pragma once
+#include "FrameCapture.h"
+#include "HeapCounter.h"
+#include "PerfCounters.h"
+#include "TrajectoryPlayer.h"
+#include "TrajectoryRecorder.h"
 #include <GLFW/glfw3.h>
 #include <cstdint>
 #include <functional>
+#include <string>
 
 class MainWindow {
 public:
@@ -14,6 +20,19 @@ public:
 
   void setRenderTexture(uint32_t glTexId, int width = 0, int height = 0);
 
+  // Current values, e.g. after a checkpoint load; no callbacks fire.
+  void setRunning(bool on) { running_ = on; }
+  void setGravity(float g) { gravity_ = g; }
+  void setViscosity(float v) { viscosity_ = v; }
+  void setStiffness(float k) { stiffness_ = k; }
+  void setQuality(int q) { quality_ = q; }
+  void setRenderRadius(float r) { renderRadius_ = r; }
+  void setColor(float r, float g, float b) {
+    color_[0] = r;
+    color_[1] = g;
+    color_[2] = b;
+  }
+
   void setOnStart(std::function<void()> cb) { onStart_ = std::move(cb); }
   void setOnStop(std::function<void()> cb) { onStop_ = std::move(cb); }
   void setOnReset(std::function<void()> cb) { onReset_ = std::move(cb); }
@@ -23,6 +42,9 @@ public:
   void setOnViscosityChanged(std::function<void(float)> cb) {
     onViscosityChanged_ = std::move(cb);
   }
+  void setOnStiffnessChanged(std::function<void(float)> cb) {
+    onStiffnessChanged_ = std::move(cb);
+  }
   void setOnQualityChanged(std::function<void(int)> cb) {
     onQualityChanged_ = std::move(cb);
   }
@@ -33,6 +55,131 @@ public:
     onColorChanged_ = std::move(cb);
   }
 
+  void setSceneInfo(const std::string &name, int segments, int emitters) {
+    sceneName_ = name;
+    sceneSegments_ = segments;
+    sceneEmitters_ = emitters;
+  }
+  void setSolverPath(const std::string &active, const std::string &cpu) {
+    solverPath_ = active;
+    cpuIsa_ = cpu;
+  }
+  void setBoundaryMode(int mode) { boundaryMode_ = mode; }
+  void setOnBoundaryModeChanged(std::function<void(int)> cb) {
+    onBoundaryModeChanged_ = std::move(cb);
+  }
+  void setCollisionMode(int mode) { collisionMode_ = mode; }
+  void setOnCollisionModeChanged(std::function<void(int)> cb) {
+    onCollisionModeChanged_ = std::move(cb);
+  }
+  void setKernel(int kernel) { kernel_ = kernel; }
+  void setOnKernelChanged(std::function<void(int)> cb) {
+    onKernelChanged_ = std::move(cb);
+  }
+  void setPrecision(int precision) { precision_ = precision; }
+  void setOnPrecisionChanged(std::function<void(int)> cb) {
+    onPrecisionChanged_ = std::move(cb);
+  }
+  void setBoundaryParticles(bool on) { boundaryParticles_ = on; }
+  void setOnBoundaryParticlesChanged(std::function<void(bool)> cb) {
+    onBoundaryParticlesChanged_ = std::move(cb);
+  }
+  void setCapacity(int capacity) { capacity_ = capacityEdit_ = capacity; }
+  void setOnCapacityChanged(std::function<void(int)> cb) {
+    onCapacityChanged_ = std::move(cb);
+  }
+  void setMemoryInfo(size_t cpuBytes, size_t gpuBytes) {
+    cpuBytes_ = cpuBytes;
+    gpuBytes_ = gpuBytes;
+  }
+  // Heap activity of the last frame; the overlay also keeps the peak.
+  void setFrameAllocations(const AllocStats &frame);
+  void setCheckpointPath(const std::string &path);
+  void setOnSaveCheckpoint(std::function<void(const std::string &)> cb) {
+    onSaveCheckpoint_ = std::move(cb);
+  }
+  void setOnLoadCheckpoint(std::function<void(const std::string &)> cb) {
+    onLoadCheckpoint_ = std::move(cb);
+  }
+  // Trajectory recording state and progress, shown under the path field.
+  void setRecording(bool on, const TrajectoryStats &stats) {
+    recording_ = on;
+    recordStats_ = stats;
+  }
+  void setRecordPath(const std::string &path);
+  // Called with true and the path to start recording, false to stop.
+  void setOnRecordChanged(
+      std::function<void(bool, const std::string &)> cb) {
+    onRecordChanged_ = std::move(cb);
+  }
+  // Playback of the trajectory file instead of the live simulation; the
+  // timeline follows the player's clock.
+  void setPlayback(const TrajectoryPlayer &player);
+  // Called with true and the path to enter playback, false to go live.
+  void setOnPlaybackChanged(
+      std::function<void(bool, const std::string &)> cb) {
+    onPlaybackChanged_ = std::move(cb);
+  }
+  void setOnPlaybackPlayingChanged(std::function<void(bool)> cb) {
+    onPlaybackPlayingChanged_ = std::move(cb);
+  }
+  void setOnPlaybackSpeedChanged(std::function<void(float)> cb) {
+    onPlaybackSpeedChanged_ = std::move(cb);
+  }
+  void setOnPlaybackLoopChanged(std::function<void(bool)> cb) {
+    onPlaybackLoopChanged_ = std::move(cb);
+  }
+  // Timeline drags, in recorded seconds.
+  void setOnPlaybackSeek(std::function<void(double)> cb) {
+    onPlaybackSeek_ = std::move(cb);
+  }
+  // Single-frame steps, -1 or +1.
+  void setOnPlaybackStep(std::function<void(int)> cb) {
+    onPlaybackStep_ = std::move(cb);
+  }
+  // Screenshot and continuous capture of the scene view into a directory.
+  void setCapture(bool capturing, const FrameCaptureStats &stats) {
+    capturing_ = capturing;
+    captureStats_ = stats;
+  }
+  void setOnScreenshot(std::function<void(const std::string &)> cb) {
+    onScreenshot_ = std::move(cb);
+  }
+  // Called with true and the directory to start capturing, false to stop.
+  void setOnCaptureChanged(
+      std::function<void(bool, const std::string &)> cb) {
+    onCaptureChanged_ = std::move(cb);
+  }
+  void setOnGenerate(std::function<void(int, int)> cb) {
+    onGenerate_ = std::move(cb);
+  }
+  void setDrainedCount(int n) { drained_ = n; }
+  void setSleepingCount(int n) { sleepingCount_ = n; }
+  void setMultiRate(bool on) { multiRate_ = on; }
+  void setOnMultiRateChanged(std::function<void(bool)> cb) {
+    onMultiRateChanged_ = std::move(cb);
+  }
+  void setLevelCounts(int l0, int l1, int l2) {
+    levelCounts_[0] = l0;
+    levelCounts_[1] = l1;
+    levelCounts_[2] = l2;
+  }
+  void setSleeping(bool on) { sleeping_ = on; }
+  void setOnSleepingChanged(std::function<void(bool)> cb) {
+    onSleepingChanged_ = std::move(cb);
+  }
+  // Hardware counter totals since they were switched on; the overlay shows
+  // the average over each window of perfWindow_ steps.
+  void setPerfCounters(bool on, const std::string &error,
+                       const PhaseCounters &total);
+  void setOnPerfCountersChanged(std::function<void(bool)> cb) {
+    onPerfCountersChanged_ = std::move(cb);
+  }
+  void setRenderMode(int mode) { renderMode_ = mode; }
+  void setOnRenderModeChanged(std::function<void(int)> cb) {
+    onRenderModeChanged_ = std::move(cb);
+  }
+
   bool isRunning() const { return running_; }
 
 private:
@@ -43,17 +190,82 @@ private:
   bool running_ = true;
   float gravity_ = 2.5f;
   float viscosity_ = 1.2f;
+  float stiffness_ = 90.0f;
   int quality_ = 3;
   float renderRadius_ = 0.022f;
   bool themeDark_ = true;
   float color_[3] = {0.15f, 0.55f, 1.0f};
+  int renderMode_ = 1;
+  int capacity_ = 550;
+  int capacityEdit_ = 550;
+  char checkpointPath_[256] = "fluid.ckpt";
+  char recordPath_[256] = "fluid.traj";
+  bool recording_ = false;
+  TrajectoryStats recordStats_;
+  char captureDir_[256] = "captures";
+  bool capturing_ = false;
+  FrameCaptureStats captureStats_;
+  bool playback_ = false;
+  bool playbackPlaying_ = false;
+  bool playbackLoop_ = true;
+  float playbackSpeed_ = 1.0f;
+  float playbackTime_ = 0.0f;
+  float playbackStart_ = 0.0f, playbackEnd_ = 0.0f;
+  int playbackFrame_ = 0, playbackFrames_ = 0;
+  size_t cpuBytes_ = 0, gpuBytes_ = 0;
+  AllocStats allocFrame_;
+  uint64_t allocPeak_[AllocTagCount] = {}; // most allocations in one frame
+  int drained_ = 0;
+  bool sleeping_ = true;
+  int sleepingCount_ = 0;
+  bool multiRate_ = true;
+  int levelCounts_[3] = {};
+  bool perfCounters_ = false;
+  std::string perfError_;
+  PhaseCounters perfMark_, perfShown_;
+  static constexpr int perfWindow_ = 30;
+  int initShape_ = 0;
+  int initCount_ = 2000;
+  int boundaryMode_ = 0;
+  int collisionMode_ = 0;
+  int kernel_ = 0;
+  int precision_ = 0;
+  bool boundaryParticles_ = true;
+  std::string sceneName_;
+  std::string solverPath_;
+  std::string cpuIsa_;
+  int sceneSegments_ = 0;
+  int sceneEmitters_ = 0;
 
   std::function<void()> onStart_;
   std::function<void()> onStop_;
   std::function<void()> onReset_;
   std::function<void(float)> onGravityChanged_;
   std::function<void(float)> onViscosityChanged_;
+  std::function<void(float)> onStiffnessChanged_;
   std::function<void(int)> onQualityChanged_;
   std::function<void(float)> onRenderRadiusChanged_;
   std::function<void(float, float, float)> onColorChanged_;
+  std::function<void(int)> onRenderModeChanged_;
+  std::function<void(int)> onCapacityChanged_;
+  std::function<void(int, int)> onGenerate_;
+  std::function<void(const std::string &)> onSaveCheckpoint_;
+  std::function<void(const std::string &)> onLoadCheckpoint_;
+  std::function<void(bool, const std::string &)> onRecordChanged_;
+  std::function<void(const std::string &)> onScreenshot_;
+  std::function<void(bool, const std::string &)> onCaptureChanged_;
+  std::function<void(bool, const std::string &)> onPlaybackChanged_;
+  std::function<void(bool)> onPlaybackPlayingChanged_;
+  std::function<void(float)> onPlaybackSpeedChanged_;
+  std::function<void(bool)> onPlaybackLoopChanged_;
+  std::function<void(double)> onPlaybackSeek_;
+  std::function<void(int)> onPlaybackStep_;
+  std::function<void(int)> onBoundaryModeChanged_;
+  std::function<void(int)> onCollisionModeChanged_;
+  std::function<void(int)> onKernelChanged_;
+  std::function<void(int)> onPrecisionChanged_;
+  std::function<void(bool)> onBoundaryParticlesChanged_;
+  std::function<void(bool)> onSleepingChanged_;
+  std::function<void(bool)> onMultiRateChanged_;
+  std::function<void(bool)> onPerfCountersChanged_;
 };
@@ -0,0 +1,110 @@
+#include "MappedFile.h"
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::Open(const std::string &path) {
+  Close();
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file != INVALID_HANDLE_VALUE) {
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+      mapping_ =
+          CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (mapping_)
+        data_ = (const uint8_t *)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0,
+                                               0);
+      if (data_) {
+        size_ = (size_t)size.QuadPart;
+        mapped_ = true;
+      }
+    }
+    CloseHandle(file);
+    if (mapped_)
+      return true;
+    Close();
+  }
+#else
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd,
+                     0);
+      if (p != MAP_FAILED) {
+        data_ = (const uint8_t *)p;
+        size_ = (size_t)st.st_size;
+        mapped_ = true;
+      }
+    }
+    ::close(fd);
+    if (mapped_)
+      return true;
+  }
+#endif
+
+  std::ifstream f(path, std::ios::binary | std::ios::ate);
+  if (!f) {
+    std::cerr << "Cannot open " << path << "\n";
+    return false;
+  }
+  size_t size = (size_t)f.tellg();
+  f.seekg(0);
+  owned_ = new uint8_t[size ? size : 1];
+  if (!f.read((char *)owned_, (std::streamsize)size)) {
+    std::cerr << "Cannot read " << path << "\n";
+    Close();
+    return false;
+  }
+  data_ = owned_;
+  size_ = size;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (mapped_) {
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+#else
+    munmap((void *)data_, size_);
+#endif
+  }
+#ifdef _WIN32
+  if (mapping_)
+    CloseHandle(mapping_);
+  mapping_ = nullptr;
+#endif
+  delete[] owned_;
+  owned_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+  mapped_ = false;
+}
+
+void MappedFile::WillNeed(size_t offset, size_t bytes) const {
+#ifndef _WIN32
+  if (!mapped_ || offset >= size_)
+    return;
+  // madvise wants a page-aligned start.
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t begin = offset / page * page;
+  size_t end = bytes > size_ - offset ? size_ : offset + bytes;
+  madvise((void *)(data_ + begin), end - begin, MADV_WILLNEED);
+#else
+  (void)offset;
+  (void)bytes;
+#endif
+}
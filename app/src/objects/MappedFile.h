@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only view of a whole file, mapped with mmap (or a file mapping on
+// Windows) so its pages are only faulted in as they are touched. Where
+// mapping fails the file is read into memory instead.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile() { Close(); }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Prints the reason and returns false on failure.
+  bool Open(const std::string &path);
+  void Close();
+
+  const uint8_t *GetData() const { return data_; }
+  size_t GetSize() const { return size_; }
+  bool IsMapped() const { return mapped_; }
+
+  // Hints that [offset, offset + bytes) will be read front to back soon.
+  void WillNeed(size_t offset, size_t bytes) const;
+
+private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  uint8_t *owned_ = nullptr; // fallback copy
+#ifdef _WIN32
+  void *mapping_ = nullptr;
+#endif
+};
@@ -0,0 +1,27 @@
+#include "NeighborGrid.h"
+#include <cmath>
+
+void NeighborGrid::SetDomain(glm::vec2 min, glm::vec2 max, float cellSize) {
+  min_ = min;
+  cell_ = cellSize;
+  invCell_ = 1.0f / cellSize;
+  nx_ = std::max(1, (int)std::ceil((max.x - min.x) * invCell_));
+  ny_ = std::max(1, (int)std::ceil((max.y - min.y) * invCell_));
+  cellStart_.clear();
+  sorted_.clear();
+}
+
+void NeighborGrid::Reserve(int points) {
+  cellOf_.reserve(points);
+  sorted_.reserve(points);
+}
+
+size_t NeighborGrid::GetBytes() const {
+  return (cellStart_.capacity() + cursor_.capacity() + cellOf_.capacity() +
+          sorted_.capacity()) *
+         sizeof(int);
+}
+
+size_t NeighborGrid::EstimateBytes(int cells, int points) {
+  return ((size_t)cells * 2 + 1 + (size_t)points * 2) * sizeof(int);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Uniform cell grid over a fixed domain, rebuilt with a counting sort.
+// Points outside the domain are clamped into the border cells. The cell
+// size must be at least the largest interaction radius so a 3x3 block of
+// cells covers every neighbour.
+class NeighborGrid {
+public:
+  void SetDomain(glm::vec2 min, glm::vec2 max, float cellSize);
+
+  // Preallocates the per-point arrays so Build() up to `points` does not
+  // touch the heap.
+  void Reserve(int points);
+  template <typename PosFn> void Build(int n, PosFn pos);
+  template <typename Fn> void ForEachNeighbor(glm::vec2 p, Fn fn) const;
+
+  int CellOf(glm::vec2 p) const;
+  float GetCellSize() const { return cell_; }
+  int GetCellCount() const { return nx_ * ny_; }
+  int GetCellsX() const { return nx_; }
+  int GetCellsY() const { return ny_; }
+  size_t GetBytes() const;
+  static size_t EstimateBytes(int cells, int points);
+
+private:
+  glm::vec2 min_ = {0.0f, 0.0f};
+  float cell_ = 1.0f, invCell_ = 1.0f;
+  int nx_ = 1, ny_ = 1;
+
+  std::vector<int> cellStart_; // nx_ * ny_ + 1 prefix offsets into sorted_
+  std::vector<int> cursor_;
+  std::vector<int> cellOf_;
+  std::vector<int> sorted_; // point indices grouped by cell
+};
+
+inline int NeighborGrid::CellOf(glm::vec2 p) const {
+  int cx = std::clamp((int)((p.x - min_.x) * invCell_), 0, nx_ - 1);
+  int cy = std::clamp((int)((p.y - min_.y) * invCell_), 0, ny_ - 1);
+  return cy * nx_ + cx;
+}
+
+template <typename PosFn> void NeighborGrid::Build(int n, PosFn pos) {
+  cellStart_.assign((size_t)nx_ * ny_ + 1, 0);
+  cellOf_.resize(n);
+  sorted_.resize(n);
+  for (int i = 0; i < n; ++i) {
+    int c = CellOf(pos(i));
+    cellOf_[i] = c;
+    ++cellStart_[c + 1];
+  }
+  for (size_t c = 1; c < cellStart_.size(); ++c)
+    cellStart_[c] += cellStart_[c - 1];
+  cursor_.assign(cellStart_.begin(), cellStart_.end() - 1);
+  for (int i = 0; i < n; ++i)
+    sorted_[cursor_[cellOf_[i]]++] = i;
+}
+
+template <typename Fn>
+FLUID_PASS_INLINE void NeighborGrid::ForEachNeighbor(glm::vec2 p, Fn fn) const {
+  if (sorted_.empty())
+    return;
+  int c = CellOf(p);
+  int cx = c % nx_, cy = c / nx_;
+  int x0 = std::max(cx - 1, 0), x1 = std::min(cx + 1, nx_ - 1);
+  int y0 = std::max(cy - 1, 0), y1 = std::min(cy + 1, ny_ - 1);
+  for (int y = y0; y <= y1; ++y) {
+    // cells in a row are contiguous, so one range covers x0..x1
+    int begin = cellStart_[y * nx_ + x0];
+    int end = cellStart_[y * nx_ + x1 + 1];
+    for (int k = begin; k < end; ++k)
+      fn(sorted_[k]);
+  }
+}
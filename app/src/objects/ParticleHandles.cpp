@@ -0,0 +1,99 @@
+#include "ParticleHandles.h"
+
+void ParticleHandles::Append(int count) {
+  slotHandle_.reserve(slotHandle_.size() + count);
+  for (int i = 0; i < count; ++i) {
+    int slot = (int)slotHandle_.size();
+    uint32_t index;
+    if (!free_.empty()) {
+      index = free_.back();
+      free_.pop_back();
+      handleSlot_[index] = slot;
+    } else {
+      index = (uint32_t)handleSlot_.size();
+      handleSlot_.push_back(slot);
+      generation_.push_back(0);
+    }
+    slotHandle_.push_back(index);
+  }
+}
+
+void ParticleHandles::SwapRemove(int slot) {
+  Release(slotHandle_[slot]);
+  uint32_t moved = slotHandle_.back();
+  slotHandle_.pop_back();
+  if (slot < (int)slotHandle_.size()) {
+    slotHandle_[slot] = moved;
+    handleSlot_[moved] = slot;
+  }
+}
+
+void ParticleHandles::Truncate(int count) {
+  while ((int)slotHandle_.size() > count) {
+    Release(slotHandle_.back());
+    slotHandle_.pop_back();
+  }
+}
+
+void ParticleHandles::Release(uint32_t index) {
+  handleSlot_[index] = -1;
+  ++generation_[index];
+  free_.push_back(index);
+}
+
+ParticleHandle ParticleHandles::Get(int slot) const {
+  uint32_t index = slotHandle_[slot];
+  return {index, generation_[index]};
+}
+
+int ParticleHandles::Find(ParticleHandle h) const {
+  if (h.index >= handleSlot_.size() || generation_[h.index] != h.generation)
+    return -1;
+  return handleSlot_[h.index];
+}
+
+bool ParticleHandles::IsValid(size_t maxHandles) const {
+  size_t handles = handleSlot_.size(), slots = slotHandle_.size();
+  if (handles > maxHandles || generation_.size() != handles ||
+      slots > handles || free_.size() != handles - slots)
+    return false;
+  for (size_t s = 0; s < slots; ++s)
+    if (slotHandle_[s] >= handles || handleSlot_[slotHandle_[s]] != (int)s)
+      return false;
+  // With every slot's handle pointing back at it, the other handle entries
+  // must be exactly the released ones.
+  size_t released = 0;
+  for (int slot : handleSlot_)
+    released += slot == -1;
+  if (released != free_.size())
+    return false;
+  // Each released handle once: a repeat would be handed out twice.
+  std::vector<bool> seen(handles);
+  for (uint32_t index : free_) {
+    if (index >= handles || handleSlot_[index] != -1 || seen[index])
+      return false;
+    seen[index] = true;
+  }
+  return true;
+}
+
+void ParticleHandles::Reserve(int particles) {
+  // Handle indices are recycled, so there are never more of them than the
+  // peak particle count.
+  slotHandle_.reserve(particles);
+  handleSlot_.reserve(particles);
+  generation_.reserve(particles);
+  free_.reserve(particles);
+}
+
+size_t ParticleHandles::GetBytes() const {
+  return slotHandle_.capacity() * sizeof(uint32_t) +
+         handleSlot_.capacity() * sizeof(int) +
+         generation_.capacity() * sizeof(uint32_t) +
+         free_.capacity() * sizeof(uint32_t);
+}
+
+size_t ParticleHandles::EstimateBytes(int particles) {
+  // slot table plus handle slot/generation, free list at worst full
+  return (size_t)particles * (3 * sizeof(uint32_t) + sizeof(int));
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Identifies one particle across swap-removes and reordering. A handle is
+// stale once its particle is removed; the generation check catches reuse of
+// the index by a later particle.
+struct ParticleHandle {
+  uint32_t index = UINT32_MAX;
+  uint32_t generation = 0;
+};
+
+// Handle <-> slot table kept in lockstep with a dense particle array. Every
+// call mirrors the matching operation on the array itself.
+class ParticleHandles {
+public:
+  // New particles were appended at slots [GetCount(), GetCount() + count).
+  void Append(int count);
+  // array[slot] = array.back(); array.pop_back();
+  void SwapRemove(int slot);
+  // array.resize(count) with count <= GetCount().
+  void Truncate(int count);
+  void Clear() { Truncate(0); }
+  // Room for `particles` live particles without reallocating.
+  void Reserve(int particles);
+
+  int GetCount() const { return (int)slotHandle_.size(); }
+  // The tables agree with each other and hold at most maxHandles handle
+  // indices: every slot and handle entry is in range and the free list
+  // names only released handles. For tables read from a file.
+  bool IsValid(size_t maxHandles) const;
+  ParticleHandle Get(int slot) const;
+  // Current slot of the particle, or -1 if it has been removed.
+  int Find(ParticleHandle h) const;
+  size_t GetBytes() const;
+  static size_t EstimateBytes(int particles);
+
+  // Calls fn(table) on each internal vector in a fixed order, for
+  // checkpoints; restoring them verbatim restores every handle.
+  template <class Fn> void VisitTables(Fn &&fn) {
+    fn(slotHandle_);
+    fn(handleSlot_);
+    fn(generation_);
+    fn(free_);
+  }
+  template <class Fn> void VisitTables(Fn &&fn) const {
+    fn(slotHandle_);
+    fn(handleSlot_);
+    fn(generation_);
+    fn(free_);
+  }
+
+private:
+  void Release(uint32_t index);
+
+  std::vector<uint32_t> slotHandle_; // slot -> handle index
+  std::vector<int> handleSlot_;      // handle index -> slot, -1 when free
+  std::vector<uint32_t> generation_; // bumped on every release
+  std::vector<uint32_t> free_;       // released handle indices
+};
@@ -0,0 +1,170 @@
+#include "ParticleRenderer.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+ParticleRenderer::ParticleRenderer(int capacity) : capacity_(capacity) {
+  std::vector<glm::vec2> mesh;
+  mesh.reserve(fanVerts_ + quadVerts_);
+  mesh.push_back({0.0f, 0.0f});
+  for (int i = 0; i <= fanSegs_; ++i) {
+    float theta = 2.0f * (float)M_PI * i / fanSegs_;
+    mesh.push_back({std::cos(theta), std::sin(theta)});
+  }
+  mesh.insert(mesh.end(), {{-1.0f, -1.0f}, {1.0f, -1.0f}, {-1.0f, 1.0f},
+                           {1.0f, 1.0f}});
+
+  glGenVertexArrays(1, &vao_);
+  glBindVertexArray(vao_);
+
+  glGenBuffers(1, &meshVBO_);
+  glBindBuffer(GL_ARRAY_BUFFER, meshVBO_);
+  glBufferData(GL_ARRAY_BUFFER, mesh.size() * sizeof(glm::vec2), mesh.data(),
+               GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+  glEnableVertexAttribArray(0);
+  glVertexAttribDivisor(0, 0);
+
+  glGenBuffers(1, &instanceVBO_);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO_);
+  glBufferData(GL_ARRAY_BUFFER, capacity_ * sizeof(glm::vec3), nullptr,
+               GL_DYNAMIC_DRAW);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+  glEnableVertexAttribArray(1);
+  glVertexAttribDivisor(1, 1);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+ParticleRenderer::~ParticleRenderer() {
+  if (vao_)
+    glDeleteVertexArrays(1, &vao_);
+  if (meshVBO_)
+    glDeleteBuffers(1, &meshVBO_);
+  if (instanceVBO_)
+    glDeleteBuffers(1, &instanceVBO_);
+}
+
+int ParticleRenderer::VerticesPerInstance(ParticleRenderMode m) {
+  switch (m) {
+  case ParticleRenderMode::TriangleFan:
+    return fanVerts_;
+  case ParticleRenderMode::Quad:
+    return quadVerts_;
+  case ParticleRenderMode::Point:
+    return 1;
+  }
+  return 0;
+}
+
+const char *ParticleRenderer::ModeName(ParticleRenderMode m) {
+  switch (m) {
+  case ParticleRenderMode::TriangleFan:
+    return "fan";
+  case ParticleRenderMode::Quad:
+    return "quad";
+  case ParticleRenderMode::Point:
+    return "point";
+  }
+  return "?";
+}
+
+size_t ParticleRenderer::MeshBytes() {
+  return (fanVerts_ + quadVerts_) * sizeof(glm::vec2);
+}
+
+size_t ParticleRenderer::GetGpuBytes() const {
+  return (size_t)capacity_ * sizeof(glm::vec3) + MeshBytes();
+}
+
+void ParticleRenderer::Reserve(int n) {
+  if (n <= capacity_)
+    return;
+  int newCap = std::max(n, capacity_ + capacity_ / 2);
+
+  GLuint vbo = 0;
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+  glBufferData(GL_COPY_WRITE_BUFFER, (size_t)newCap * sizeof(glm::vec3),
+               nullptr, GL_DYNAMIC_DRAW);
+  if (uploaded_ > 0) {
+    glBindBuffer(GL_COPY_READ_BUFFER, instanceVBO_);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                        (size_t)uploaded_ * sizeof(glm::vec3));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glDeleteBuffers(1, &instanceVBO_);
+  instanceVBO_ = vbo;
+  capacity_ = newCap;
+
+  glBindVertexArray(vao_);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO_);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleRenderer::Upload(const glm::vec3 *inst, int n) {
+  if (n <= 0)
+    return;
+  Reserve(n);
+  uploaded_ = n;
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO_);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(glm::vec3), inst);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleRenderer::Draw(GLuint program, const ParticleUniforms &u,
+                            float radius, glm::vec3 colorLow,
+                            glm::vec3 colorHigh, float maxSpeed,
+                            int n) const {
+  if (n <= 0)
+    return;
+  if (n > capacity_)
+    n = capacity_;
+
+  glUseProgram(program);
+  if (u.radius >= 0)
+    glUniform1f(u.radius, radius);
+  if (u.colorLow >= 0)
+    glUniform3fv(u.colorLow, 1, &colorLow[0]);
+  if (u.colorHigh >= 0)
+    glUniform3fv(u.colorHigh, 1, &colorHigh[0]);
+  if (u.maxSpeed >= 0)
+    glUniform1f(u.maxSpeed, maxSpeed);
+  if (u.mode >= 0)
+    glUniform1i(u.mode, (int)mode_);
+  if (u.pointScale >= 0) {
+    // Pixels per NDC unit of diameter on each axis: the fan and quad are
+    // stretched with the viewport, and points are drawn to match.
+    GLint vp[4];
+    glGetIntegerv(GL_VIEWPORT, vp);
+    glUniform2f(u.pointScale, (float)vp[2], (float)vp[3]);
+  }
+
+  glBindVertexArray(vao_);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  switch (mode_) {
+  case ParticleRenderMode::TriangleFan:
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, fanVerts_, n);
+    break;
+  case ParticleRenderMode::Quad:
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, fanVerts_, quadVerts_, n);
+    break;
+  case ParticleRenderMode::Point:
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glDrawArraysInstanced(GL_POINTS, 0, 1, n);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+    break;
+  }
+  glDisable(GL_BLEND);
+  glBindVertexArray(0);
+  glUseProgram(0);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+enum class ParticleRenderMode { TriangleFan = 0, Quad = 1, Point = 2 };
+
+struct ParticleUniforms {
+  GLint radius = -1;
+  GLint colorLow = -1;
+  GLint colorHigh = -1;
+  GLint mode = -1;
+  GLint pointScale = -1;
+  GLint maxSpeed = -1;
+};
+
+// Instanced particle impostors. One static mesh buffer holds the 16-vertex
+// fan followed by a 4-vertex quad; point mode reuses the fan centre vertex.
+class ParticleRenderer {
+public:
+  explicit ParticleRenderer(int capacity);
+  ~ParticleRenderer();
+
+  // Grows the instance buffer geometrically (never shrinks) and keeps the
+  // uploaded instances; a no-op when n already fits.
+  void Reserve(int n);
+  void Upload(const glm::vec3 *inst, int n);
+  void Draw(GLuint program, const ParticleUniforms &u, float radius,
+            glm::vec3 colorLow, glm::vec3 colorHigh, float maxSpeed,
+            int n) const;
+
+  void SetMode(ParticleRenderMode m) { mode_ = m; }
+  ParticleRenderMode GetMode() const { return mode_; }
+  int GetCapacity() const { return capacity_; }
+  size_t GetGpuBytes() const;
+  static size_t MeshBytes();
+
+  static int VerticesPerInstance(ParticleRenderMode m);
+  static const char *ModeName(ParticleRenderMode m);
+
+private:
+  static constexpr int fanSegs_ = 14;
+  static constexpr int fanVerts_ = fanSegs_ + 2;
+  static constexpr int quadVerts_ = 4;
+
+  ParticleRenderMode mode_ = ParticleRenderMode::Quad;
+  int capacity_ = 0;
+  int uploaded_ = 0;
+
+  GLuint vao_ = 0;
+  GLuint meshVBO_ = 0;
+  GLuint instanceVBO_ = 0;
+};
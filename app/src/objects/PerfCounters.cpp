@@ -0,0 +1,190 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char *PerfEventName(PerfEvent e) {
+  switch (e) {
+  case PerfEvent::Cycles:
+    return "cycles";
+  case PerfEvent::Instructions:
+    return "instructions";
+  case PerfEvent::L1dMisses:
+    return "L1d misses";
+  case PerfEvent::LlcMisses:
+    return "LLC misses";
+  default:
+    return "branch misses";
+  }
+}
+
+const char *SolverPhaseName(SolverPhase p) {
+  switch (p) {
+  case SolverPhase::Emit:
+    return "emit";
+  case SolverPhase::Grid:
+    return "grid";
+  case SolverPhase::Density:
+    return "density";
+  case SolverPhase::Forces:
+    return "forces";
+  case SolverPhase::Integrate:
+    return "integrate";
+  case SolverPhase::Collisions:
+    return "collisions";
+  case SolverPhase::Boundaries:
+    return "boundaries";
+  default:
+    return "cells";
+  }
+}
+
+void PhaseCounters::Add(const PhaseCounters &o) {
+  for (int p = 0; p < SolverPhaseCount; ++p)
+    for (int e = 0; e < PerfEventCount; ++e)
+      phases[p].v[e] += o.phases[p].v[e];
+  particles += o.particles;
+  steps += o.steps;
+}
+
+PerfSample PhaseCounters::Sum() const {
+  PerfSample s;
+  for (const PerfSample &p : phases)
+    for (int e = 0; e < PerfEventCount; ++e)
+      s.v[e] += p.v[e];
+  return s;
+}
+
+#ifdef __linux__
+
+static int OpenEvent(PerfEvent e, int tid, int groupFd) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  switch (e) {
+  case PerfEvent::Cycles:
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    break;
+  case PerfEvent::Instructions:
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    break;
+  case PerfEvent::L1dMisses:
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_L1D |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    break;
+  case PerfEvent::LlcMisses:
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    break;
+  case PerfEvent::BranchMisses:
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    break;
+  }
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, tid, -1, groupFd,
+                      PERF_FLAG_FD_CLOEXEC);
+}
+
+bool PerfCounters::Open(const std::vector<int> &threadIds) {
+  Close();
+  error_.clear();
+  // The first thread decides which events exist; the others must open the
+  // same set so every group reads back in the same order.
+  for (int tid : threadIds) {
+    Group g;
+    bool first = groups_.empty();
+    for (int i = 0; i < PerfEventCount; ++i) {
+      PerfEvent e = (PerfEvent)i;
+      if (!first && !HasEvent(e))
+        continue;
+      int fd = OpenEvent(e, tid, g.leader);
+      if (fd < 0) {
+        if (first && e == PerfEvent::Cycles) { // the group leader
+          error_ = std::string("perf_event_open: ") + std::strerror(errno);
+          if (errno == EACCES || errno == EPERM)
+            error_ += " (see /proc/sys/kernel/perf_event_paranoid)";
+          Close();
+          return false;
+        }
+        if (first)
+          continue; // not supported here; leave it out
+        break;
+      }
+      if (g.leader < 0)
+        g.leader = fd;
+      g.fds.push_back(fd);
+      if (first) {
+        events_.push_back(e);
+        mask_ |= 1u << i;
+      }
+    }
+    if (g.fds.size() != events_.size()) {
+      // Count the threads that did open; this one goes uncounted.
+      std::string why = std::strerror(errno);
+      error_ = "perf_event_open for thread " + std::to_string(tid) + ": " +
+               why + ", not counted";
+      for (int f : g.fds)
+        close(f);
+      continue;
+    }
+    groups_.push_back(std::move(g));
+    threadIds_.push_back(tid);
+  }
+  Lap();
+  return IsOpen();
+}
+
+void PerfCounters::Close() {
+  for (Group &g : groups_)
+    for (int fd : g.fds)
+      close(fd);
+  groups_.clear();
+  threadIds_.clear();
+  events_.clear();
+  mask_ = 0;
+}
+
+PerfSample PerfCounters::Lap() {
+  PerfSample s;
+  for (Group &g : groups_) {
+    uint64_t buf[3 + PerfEventCount];
+    ssize_t got = read(g.leader, buf, sizeof(buf));
+    if (got < (ssize_t)(3 * sizeof(uint64_t)) || buf[0] != events_.size())
+      continue;
+    // buf: count, time enabled, time running, then one value per event.
+    // The raw values only grow; the scaled estimates need not.
+    uint64_t enabled = buf[1] - g.enabled, running = buf[2] - g.running;
+    double scale = running ? (double)enabled / (double)running : 0.0;
+    for (size_t i = 0; i < events_.size(); ++i) {
+      int e = (int)events_[i];
+      s.v[e] += (uint64_t)((double)(buf[3 + i] - g.counts[e]) * scale);
+      g.counts[e] = buf[3 + i];
+    }
+    g.enabled = buf[1];
+    g.running = buf[2];
+  }
+  return s;
+}
+
+#else
+
+bool PerfCounters::Open(const std::vector<int> &) {
+  error_ = "hardware counters need Linux perf_event_open";
+  return false;
+}
+
+void PerfCounters::Close() {}
+
+PerfSample PerfCounters::Lap() { return {}; }
+
+#endif
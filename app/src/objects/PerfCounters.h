@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Hardware counters through Linux perf_event_open, user space only. Each
+// event that the CPU, kernel or hypervisor refuses is left out; if none
+// open (no PMU in the VM, perf_event_paranoid, other platforms) the set
+// stays closed and GetError() says why. A thread whose group fails to open
+// after the first is left out too, and GetError() names it.
+enum class PerfEvent {
+  Cycles = 0,
+  Instructions = 1,
+  L1dMisses = 2, // L1 data read misses
+  LlcMisses = 3, // last-level cache misses
+  BranchMisses = 4
+};
+inline constexpr int PerfEventCount = 5;
+
+const char *PerfEventName(PerfEvent e);
+
+struct PerfSample {
+  uint64_t v[PerfEventCount] = {};
+
+  uint64_t operator[](PerfEvent e) const { return v[(int)e]; }
+};
+
+// One counter group per thread, read together and summed. Counts are
+// scaled up when the kernel had to multiplex the group.
+class PerfCounters {
+public:
+  PerfCounters() = default;
+  ~PerfCounters() { Close(); }
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  // Counts the given OS thread ids (see JobSystem::GetThreadIds).
+  bool Open(const std::vector<int> &threadIds);
+  void Close();
+  bool IsOpen() const { return !groups_.empty(); }
+  bool HasEvent(PerfEvent e) const { return (mask_ >> (int)e) & 1; }
+  const std::vector<int> &GetThreadIds() const { return threadIds_; }
+  const std::string &GetError() const { return error_; }
+
+  // Counts since the previous Lap() or Open(). Each group's raw counts
+  // are scaled by its enabled / running time over the same interval, so a
+  // multiplexed group never gives a negative difference.
+  PerfSample Lap();
+
+private:
+  struct Group {
+    int leader = -1;
+    std::vector<int> fds; // leader first, in events_ order
+    // At the previous Lap(): time enabled, time running, raw counts.
+    uint64_t enabled = 0, running = 0;
+    uint64_t counts[PerfEventCount] = {};
+  };
+  std::vector<Group> groups_;
+  std::vector<int> threadIds_;
+  std::vector<PerfEvent> events_; // as opened, the group read order
+  unsigned mask_ = 0;
+  std::string error_;
+};
+
+// Phases of FluidSim::Update that get their own counts.
+enum class SolverPhase {
+  Emit = 0, // sinks, classification and spawning
+  Grid = 1,
+  Density = 2,
+  Forces = 3,
+  Integrate = 4,
+  Collisions = 5,
+  Boundaries = 6,
+  Cells = 7 // sleep and rate-level bookkeeping
+};
+inline constexpr int SolverPhaseCount = 8;
+
+const char *SolverPhaseName(SolverPhase p);
+
+// Counts per phase over one or more steps; particles is summed per step,
+// so dividing by it gives counts per particle per step.
+struct PhaseCounters {
+  PerfSample phases[SolverPhaseCount];
+  uint64_t particles = 0;
+  int steps = 0;
+  unsigned events = 0; // bit per PerfEvent that was counted
+
+  void Add(const PhaseCounters &o);
+  PerfSample Sum() const; // over all phases
+  bool Has(PerfEvent e) const { return (events >> (int)e) & 1; }
+  double PerParticle(const PerfSample &s, PerfEvent e) const {
+    return particles ? (double)s[e] / (double)particles : 0.0;
+  }
+  static double Ipc(const PerfSample &s) {
+    uint64_t cycles = s[PerfEvent::Cycles];
+    return cycles ? (double)s[PerfEvent::Instructions] / (double)cycles : 0.0;
+  }
+};
@@ -0,0 +1,107 @@
+#include "RenderBench.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static double RasterArea(ParticleRenderMode m, double rx, double ry,
+                         double pointPx) {
+  switch (m) {
+  case ParticleRenderMode::TriangleFan: {
+    const int segs = ParticleRenderer::VerticesPerInstance(m) - 2;
+    return 0.5 * segs * std::sin(2.0 * M_PI / segs) * rx * ry;
+  }
+  case ParticleRenderMode::Quad:
+    return 4.0 * rx * ry;
+  case ParticleRenderMode::Point:
+    return pointPx * pointPx;
+  }
+  return 0.0;
+}
+
+std::vector<RenderBenchResult>
+RunRenderBenchmark(GLuint program, const ParticleUniforms &u, GLuint fbo,
+                   int width, int height, int count, int frames, float radius) {
+  std::vector<glm::vec3> inst(count);
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> distP(-0.85f, 0.85f);
+  std::uniform_real_distribution<float> distS(0.0f, 1.0f);
+  for (auto &v : inst)
+    v = {distP(rng), distP(rng), distS(rng)};
+
+  ParticleRenderer renderer(count);
+  renderer.Upload(inst.data(), count);
+
+  GLuint queries[2];
+  glGenQueries(2, queries);
+
+  const glm::vec3 lo(0.15f, 0.55f, 1.0f), hi(0.9f, 0.9f, 0.9f);
+  const double rx = radius * width * 0.5, ry = radius * height * 0.5;
+  const double fbPixels = (double)width * height;
+
+  std::vector<RenderBenchResult> results;
+  for (auto mode : {ParticleRenderMode::TriangleFan, ParticleRenderMode::Quad,
+                    ParticleRenderMode::Point}) {
+    renderer.SetMode(mode);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+
+    // warm up shader/state caches
+    for (int i = 0; i < 3; ++i) {
+      glClear(GL_COLOR_BUFFER_BIT);
+      renderer.Draw(program, u, radius, lo, hi, 1.0f, count);
+    }
+    glFinish();
+
+    GLuint64 totalNs = 0, totalSamples = 0;
+    for (int i = 0; i < frames; ++i) {
+      glClear(GL_COLOR_BUFFER_BIT);
+      glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+      glBeginQuery(GL_SAMPLES_PASSED, queries[1]);
+      renderer.Draw(program, u, radius, lo, hi, 1.0f, count);
+      glEndQuery(GL_SAMPLES_PASSED);
+      glEndQuery(GL_TIME_ELAPSED);
+
+      GLuint64 ns = 0, samples = 0;
+      glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &ns);
+      glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &samples);
+      totalNs += ns;
+      totalSamples += samples;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    RenderBenchResult r;
+    r.mode = mode;
+    r.vertsPerInstance = ParticleRenderer::VerticesPerInstance(mode);
+    r.gpuMs = totalNs / 1e6 / frames;
+    double verts = (double)r.vertsPerInstance * count;
+    r.mvertsPerSec = r.gpuMs > 0.0 ? verts / (r.gpuMs * 1e3) : 0.0;
+    r.rasterPxPerParticle = RasterArea(mode, rx, ry, radius * height);
+    r.circlePxPerParticle = mode == ParticleRenderMode::Point
+                                ? M_PI * ry * ry
+                                : M_PI * rx * ry;
+    r.samplesPerDraw = (double)totalSamples / frames;
+    r.overdraw = r.samplesPerDraw / fbPixels;
+    results.push_back(r);
+  }
+
+  glDeleteQueries(2, queries);
+  return results;
+}
+
+void PrintRenderBenchmark(const std::vector<RenderBenchResult> &results,
+                          int count) {
+  std::printf("render benchmark: %d particles\n", count);
+  std::printf("%-6s %6s %10s %10s %12s %12s %12s %9s\n", "mode", "v/inst",
+              "gpu ms", "Mvert/s", "raster px/p", "disc px/p", "samples",
+              "overdraw");
+  for (const auto &r : results) {
+    std::printf("%-6s %6d %10.3f %10.1f %12.1f %12.1f %12.0f %9.2f\n",
+                ParticleRenderer::ModeName(r.mode), r.vertsPerInstance,
+                r.gpuMs, r.mvertsPerSec, r.rasterPxPerParticle,
+                r.circlePxPerParticle, r.samplesPerDraw, r.overdraw);
+  }
+}
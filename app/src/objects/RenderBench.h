@@ -0,0 +1,24 @@
+#pragma once
+#include "ParticleRenderer.h"
+#include <glad/glad.h>
+#include <vector>
+
+struct RenderBenchResult {
+  ParticleRenderMode mode;
+  int vertsPerInstance = 0;
+  double gpuMs = 0.0;           // per draw
+  double mvertsPerSec = 0.0;    // vertex throughput
+  double rasterPxPerParticle = 0.0; // analytic rasterized area
+  double circlePxPerParticle = 0.0; // visible disc area
+  double samplesPerDraw = 0.0;  // fragments that passed (GL_SAMPLES_PASSED)
+  double overdraw = 0.0;        // samples / framebuffer pixels
+};
+
+// Draws `count` random instances into `fbo` with every impostor mode and
+// measures GPU time and written samples with GL queries.
+std::vector<RenderBenchResult>
+RunRenderBenchmark(GLuint program, const ParticleUniforms &u, GLuint fbo,
+                   int width, int height, int count, int frames, float radius);
+
+void PrintRenderBenchmark(const std::vector<RenderBenchResult> &results,
+                          int count);
@@ -0,0 +1,475 @@
+#include "Scene.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+int Scene::GetSegmentCount() const {
+  int n = 0;
+  for (const auto &p : polygons)
+    n += (int)p.size();
+  for (const auto &l : polylines)
+    n += std::max(0, (int)l.pts.size() - 1);
+  return n;
+}
+
+static bool Finite(glm::vec2 v) {
+  return std::isfinite(v.x) && std::isfinite(v.y);
+}
+
+static bool Finite(const std::vector<glm::vec2> &pts) {
+  return std::all_of(pts.begin(), pts.end(),
+                     [](glm::vec2 v) { return Finite(v); });
+}
+
+// Min and max corners of a non-inverted box.
+static bool ValidBox(glm::vec2 min, glm::vec2 max) {
+  return Finite(min) && Finite(max) && min.x <= max.x && min.y <= max.y;
+}
+
+std::string Scene::Validate() const {
+  auto nth = [](const char *what, size_t i, const char *problem) {
+    return std::string(what) + " " + std::to_string(i + 1) + ": " + problem;
+  };
+  if (!ValidBox(containerMin, containerMax) ||
+      !(containerMax.x > containerMin.x && containerMax.y > containerMin.y))
+    return "container must be a finite box with a positive size";
+  if (sdfResolution < 16 || sdfResolution > maxSdfResolution)
+    return "sdf resolution must be 16 .. " + std::to_string(maxSdfResolution);
+  for (size_t i = 0; i < emitters.size(); ++i) {
+    const SceneEmitter &e = emitters[i];
+    if (!ValidBox(e.min, e.max))
+      return nth("emitter", i, "box must be finite");
+    if (!Finite(e.dir) || std::abs(glm::length(e.dir) - 1.0f) > 1e-3f)
+      return nth("emitter", i, "direction must be a unit vector");
+    if (!std::isfinite(e.speed) || !std::isfinite(e.interval) ||
+        !(e.interval > 0.0f) || !(e.jitter >= 0.0f) ||
+        !std::isfinite(e.jitter))
+      return nth("emitter", i,
+                 "speed must be finite, interval > 0 and jitter >= 0");
+    if (e.burst < 1 || e.burst > maxEmitterBurst)
+      return nth("emitter", i, "burst must be 1 .. ") +
+             std::to_string(maxEmitterBurst);
+  }
+  for (size_t i = 0; i < sinks.size(); ++i)
+    if (!ValidBox(sinks[i].min, sinks[i].max))
+      return nth("sink", i, "box must be finite");
+  for (size_t i = 0; i < polygons.size(); ++i) {
+    if (polygons[i].size() < 3)
+      return nth("polygon", i, "needs at least 3 points");
+    if (!Finite(polygons[i]))
+      return nth("polygon", i, "points must be finite");
+  }
+  for (size_t i = 0; i < polylines.size(); ++i) {
+    const ScenePolyline &l = polylines[i];
+    if (!std::isfinite(l.thickness) || !(l.thickness > 0.0f))
+      return nth("polyline", i, "needs a positive thickness");
+    if (l.pts.size() < 2)
+      return nth("polyline", i, "needs at least 2 points");
+    if (!Finite(l.pts))
+      return nth("polyline", i, "points must be finite");
+  }
+  return {};
+}
+
+Scene Scene::Default() {
+  Scene s;
+  s.polygons.push_back({{-0.28f, -0.85f}, {0.28f, -0.85f}, {0.00f, -0.46f}});
+  return s;
+}
+
+// ---------- text format ----------
+//   # comment
+//   name <text>
+//   container x0 y0 x1 y1
+//   sdf <resolution>
+//   source x0 y0 x1 y1
+//   emitter x0 y0 x1 y1 dx dy [speed interval burst jitter seed]
+//   sink x0 y0 x1 y1
+//   polygon x y x y x y ...
+//   polyline <thickness> x y x y ...
+
+static bool LoadText(std::istream &in, const std::string &path, Scene &out) {
+  std::string line;
+  int lineNo = 0;
+  bool ownEmitters = false; // first source/emitter line drops the default
+  while (std::getline(in, line)) {
+    ++lineNo;
+    auto hash = line.find('#');
+    if (hash != std::string::npos)
+      line.resize(hash);
+    std::istringstream ss(line);
+    std::string key;
+    if (!(ss >> key))
+      continue;
+
+    auto fail = [&](const char *what) {
+      std::cerr << path << ":" << lineNo << ": " << what << "\n";
+      return false;
+    };
+    auto readPoints = [&](std::vector<glm::vec2> &pts) {
+      float x, y;
+      while (ss >> x >> y)
+        pts.push_back({x, y});
+    };
+
+    if (key == "name") {
+      std::getline(ss >> std::ws, out.name);
+    } else if (key == "container") {
+      glm::vec2 a, b;
+      if (!(ss >> a.x >> a.y >> b.x >> b.y))
+        return fail("container needs x0 y0 x1 y1");
+      out.containerMin = glm::min(a, b);
+      out.containerMax = glm::max(a, b);
+    } else if (key == "sdf") {
+      if (!(ss >> out.sdfResolution))
+        return fail("sdf needs a resolution");
+    } else if (key == "source" || key == "emitter") {
+      glm::vec2 a, b;
+      if (!(ss >> a.x >> a.y >> b.x >> b.y))
+        return fail("source/emitter needs x0 y0 x1 y1");
+      if (!ownEmitters)
+        out.emitters.clear();
+      ownEmitters = true;
+      SceneEmitter e;
+      e.min = glm::min(a, b);
+      e.max = glm::max(a, b);
+      e.seed += (uint32_t)out.emitters.size();
+      if (key == "emitter") {
+        if (!(ss >> e.dir.x >> e.dir.y) || glm::length(e.dir) < 1e-6f)
+          return fail("emitter needs a non-zero direction dx dy");
+        e.dir = glm::normalize(e.dir);
+        // Optional trailing fields keep their defaults when absent.
+        auto opt = [&](auto &v) {
+          auto t = v;
+          if (ss >> t)
+            v = t;
+        };
+        opt(e.speed);
+        opt(e.interval);
+        opt(e.burst);
+        opt(e.jitter);
+        opt(e.seed);
+      }
+      out.emitters.push_back(e);
+    } else if (key == "sink") {
+      glm::vec2 a, b;
+      if (!(ss >> a.x >> a.y >> b.x >> b.y))
+        return fail("sink needs x0 y0 x1 y1");
+      out.sinks.push_back({glm::min(a, b), glm::max(a, b)});
+    } else if (key == "polygon") {
+      std::vector<glm::vec2> pts;
+      readPoints(pts);
+      out.polygons.push_back(std::move(pts));
+    } else if (key == "polyline") {
+      ScenePolyline pl;
+      if (!(ss >> pl.thickness))
+        return fail("polyline needs a thickness");
+      readPoints(pl.pts);
+      out.polylines.push_back(std::move(pl));
+    } else {
+      return fail("unknown keyword");
+    }
+  }
+  return true;
+}
+
+// ---------- SVG subset ----------
+
+static std::string Attribute(const std::string &tag, const char *name) {
+  std::string key = std::string(" ") + name + "=";
+  size_t p = tag.find(key);
+  if (p == std::string::npos)
+    return {};
+  p += key.size();
+  if (p >= tag.size() || (tag[p] != '"' && tag[p] != '\''))
+    return {};
+  char q = tag[p++];
+  size_t e = tag.find(q, p);
+  return e == std::string::npos ? std::string() : tag.substr(p, e - p);
+}
+
+static std::vector<float> ParseNumbers(const std::string &s) {
+  std::vector<float> v;
+  const char *c = s.c_str();
+  while (*c) {
+    if (std::isdigit((unsigned char)*c) || *c == '-' || *c == '+' ||
+        *c == '.') {
+      char *end = nullptr;
+      float f = std::strtof(c, &end);
+      if (end == c) {
+        ++c;
+        continue;
+      }
+      v.push_back(f);
+      c = end;
+    } else {
+      ++c;
+    }
+  }
+  return v;
+}
+
+struct SvgShape {
+  std::vector<glm::vec2> pts;
+  bool closed = false;
+  float stroke = 0.0f;
+};
+
+static void ParsePathData(const std::string &d, float stroke,
+                          std::vector<SvgShape> &shapes) {
+  SvgShape cur;
+  cur.stroke = stroke;
+  glm::vec2 pen(0.0f), start(0.0f);
+  auto flush = [&](bool closed) {
+    if (cur.pts.size() >= 2) {
+      cur.closed = closed;
+      shapes.push_back(cur);
+    }
+    cur.pts.clear();
+  };
+
+  size_t i = 0;
+  char cmd = 0;
+  while (i < d.size()) {
+    char c = d[i];
+    if (std::isalpha((unsigned char)c)) {
+      cmd = c;
+      ++i;
+      if (cmd == 'Z' || cmd == 'z') {
+        flush(true);
+        pen = start;
+      }
+      continue;
+    }
+    if (std::isspace((unsigned char)c) || c == ',') {
+      ++i;
+      continue;
+    }
+
+    // Collect the argument run for the current command.
+    size_t j = i;
+    while (j < d.size() && !std::isalpha((unsigned char)d[j]))
+      ++j;
+    // 'e' is alphabetic but belongs to exponents; keep scanning over it.
+    while (j < d.size() && (d[j] == 'e' || d[j] == 'E')) {
+      ++j;
+      while (j < d.size() && !std::isalpha((unsigned char)d[j]))
+        ++j;
+    }
+    std::vector<float> a = ParseNumbers(d.substr(i, j - i));
+    i = j;
+
+    bool rel = std::islower((unsigned char)cmd);
+    auto lineTo = [&](glm::vec2 p) {
+      pen = p;
+      cur.pts.push_back(pen);
+    };
+    size_t k = 0;
+    switch (std::toupper((unsigned char)cmd)) {
+    case 'M':
+      for (bool first = true; k + 1 < a.size(); k += 2, first = false) {
+        glm::vec2 p(a[k], a[k + 1]);
+        if (rel)
+          p += pen;
+        if (first) {
+          flush(false);
+          start = p;
+        }
+        lineTo(p); // extra pairs are implicit line-tos
+      }
+      break;
+    case 'L':
+    case 'T':
+      for (; k + 1 < a.size(); k += 2)
+        lineTo(rel ? pen + glm::vec2(a[k], a[k + 1])
+                   : glm::vec2(a[k], a[k + 1]));
+      break;
+    case 'H':
+      for (; k < a.size(); ++k)
+        lineTo({rel ? pen.x + a[k] : a[k], pen.y});
+      break;
+    case 'V':
+      for (; k < a.size(); ++k)
+        lineTo({pen.x, rel ? pen.y + a[k] : a[k]});
+      break;
+    default: {
+      // Curves and arcs: keep only the end point of each segment.
+      char u = (char)std::toupper((unsigned char)cmd);
+      size_t n = u == 'C' ? 6 : (u == 'S' || u == 'Q') ? 4 : u == 'A' ? 7 : 2;
+      for (; k + n <= a.size(); k += n) {
+        glm::vec2 p(a[k + n - 2], a[k + n - 1]);
+        lineTo(rel ? pen + p : p);
+      }
+      break;
+    }
+    }
+  }
+  flush(false);
+}
+
+static bool LoadSvg(const std::string &text, const std::string &path,
+                    Scene &out) {
+  std::vector<SvgShape> shapes;
+  glm::vec2 vbMin(0.0f), vbSize(0.0f);
+
+  size_t pos = 0;
+  while ((pos = text.find('<', pos)) != std::string::npos) {
+    size_t end = text.find('>', pos);
+    if (end == std::string::npos)
+      break;
+    std::string tag = text.substr(pos, end - pos);
+    for (auto &ch : tag)
+      if (ch == '\n' || ch == '\t' || ch == '\r')
+        ch = ' ';
+    pos = end + 1;
+
+    float stroke = 0.0f;
+    std::string sw = Attribute(tag, "stroke-width");
+    if (!sw.empty())
+      stroke = std::strtof(sw.c_str(), nullptr);
+
+    if (tag.rfind("<svg", 0) == 0) {
+      auto vb = ParseNumbers(Attribute(tag, "viewBox"));
+      if (vb.size() == 4) {
+        vbMin = {vb[0], vb[1]};
+        vbSize = {vb[2], vb[3]};
+      }
+    } else if (tag.rfind("<path", 0) == 0) {
+      ParsePathData(Attribute(tag, "d"), stroke, shapes);
+    } else if (tag.rfind("<polygon", 0) == 0 ||
+               tag.rfind("<polyline", 0) == 0) {
+      auto v = ParseNumbers(Attribute(tag, "points"));
+      SvgShape s;
+      s.closed = tag.rfind("<polygon", 0) == 0;
+      s.stroke = stroke;
+      for (size_t k = 0; k + 1 < v.size(); k += 2)
+        s.pts.push_back({v[k], v[k + 1]});
+      if (s.pts.size() >= 2)
+        shapes.push_back(std::move(s));
+    }
+  }
+
+  if (shapes.empty()) {
+    std::cerr << path << ": no path, polygon or polyline elements\n";
+    return false;
+  }
+
+  if (vbSize.x <= 0.0f || vbSize.y <= 0.0f) {
+    glm::vec2 lo(1e30f), hi(-1e30f);
+    for (const auto &s : shapes)
+      for (auto p : s.pts) {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+      }
+    vbMin = lo;
+    vbSize = glm::max(hi - lo, glm::vec2(1e-6f));
+  }
+
+  // Fit the view box into the container (uniform scale, y up).
+  glm::vec2 cExt = out.containerMax - out.containerMin;
+  float scale = std::min(cExt.x / vbSize.x, cExt.y / vbSize.y);
+  glm::vec2 offset =
+      out.containerMin + (cExt - vbSize * scale) * 0.5f;
+  auto map = [&](glm::vec2 p) {
+    glm::vec2 q = p - vbMin;
+    return glm::vec2(offset.x + q.x * scale,
+                     offset.y + (vbSize.y - q.y) * scale);
+  };
+
+  for (auto &s : shapes) {
+    std::vector<glm::vec2> pts;
+    pts.reserve(s.pts.size());
+    for (auto p : s.pts)
+      pts.push_back(map(p));
+    if (s.closed && pts.size() >= 3) {
+      out.polygons.push_back(std::move(pts));
+    } else {
+      float th = s.stroke > 0.0f ? s.stroke * scale : 0.01f;
+      out.polylines.push_back({std::move(pts), th});
+    }
+  }
+  return true;
+}
+
+bool LoadSceneFile(const std::string &path, Scene &out) {
+  std::ifstream f(path);
+  if (!f) {
+    std::cerr << "Cannot open scene " << path << "\n";
+    return false;
+  }
+  Scene s;
+  s.name = std::filesystem::path(path).filename().string();
+
+  bool svg = path.size() >= 4 &&
+             path.compare(path.size() - 4, 4, ".svg") == 0;
+  bool ok;
+  if (svg) {
+    std::stringstream buf;
+    buf << f.rdbuf();
+    ok = LoadSvg(buf.str(), path, s);
+  } else {
+    ok = LoadText(f, path, s);
+  }
+  if (!ok)
+    return false;
+  std::string problem = s.Validate();
+  if (!problem.empty()) {
+    std::cerr << path << ": " << problem << "\n";
+    return false;
+  }
+  out = std::move(s);
+  return true;
+}
+
+static float Cross(glm::vec2 a, glm::vec2 b, glm::vec2 c) {
+  return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+void TriangulatePolygon(const std::vector<glm::vec2> &poly,
+                        std::vector<glm::vec2> &outTris) {
+  int n = (int)poly.size();
+  if (n < 3)
+    return;
+
+  float area = 0.0f;
+  for (int i = 0, j = n - 1; i < n; j = i++)
+    area += poly[j].x * poly[i].y - poly[i].x * poly[j].y;
+  float orient = area >= 0.0f ? 1.0f : -1.0f;
+
+  std::vector<int> idx(n);
+  for (int i = 0; i < n; ++i)
+    idx[i] = i;
+
+  int guard = 0;
+  size_t i = 0;
+  while (idx.size() > 3 && guard < 2 * n * n) {
+    ++guard;
+    size_t m = idx.size();
+    glm::vec2 a = poly[idx[(i + m - 1) % m]];
+    glm::vec2 b = poly[idx[i % m]];
+    glm::vec2 c = poly[idx[(i + 1) % m]];
+    bool ear = Cross(a, b, c) * orient > 0.0f;
+    for (size_t k = 0; ear && k < m; ++k) {
+      glm::vec2 p = poly[idx[k]];
+      if (p == a || p == b || p == c)
+        continue;
+      if (Cross(a, b, p) * orient >= 0.0f &&
+          Cross(b, c, p) * orient >= 0.0f && Cross(c, a, p) * orient >= 0.0f)
+        ear = false;
+    }
+    if (ear) {
+      outTris.insert(outTris.end(), {a, b, c});
+      idx.erase(idx.begin() + (i % m));
+    } else {
+      ++i;
+    }
+  }
+  if (idx.size() == 3)
+    outTris.insert(outTris.end(),
+                   {poly[idx[0]], poly[idx[1]], poly[idx[2]]});
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+struct ScenePolyline {
+  std::vector<glm::vec2> pts;
+  float thickness = 0.02f;
+};
+
+// Fluid source. Every `interval` seconds it releases `burst` particles
+// (times the quality setting) from a line just outside the rectangle's face
+// along `dir`, moving at `speed` with +-`jitter` sideways velocity. Each
+// emitter draws from its own RNG stream seeded with `seed`.
+struct SceneEmitter {
+  glm::vec2 min = {-0.09f, 0.78f};
+  glm::vec2 max = {0.09f, 0.88f};
+  glm::vec2 dir = {0.0f, -1.0f};
+  float speed = 0.4f;
+  float interval = 0.3f;
+  int burst = 1;
+  float jitter = 0.15f;
+  uint32_t seed = 42;
+};
+
+// Outflow region; particles inside it are removed at the start of a frame.
+struct SceneSink {
+  glm::vec2 min = {0.0f, 0.0f};
+  glm::vec2 max = {0.0f, 0.0f};
+};
+
+// Static scene description: the container box, solid polygons, thick open
+// polylines (pipe and channel walls), the fluid emitters and sinks.
+struct Scene {
+  static constexpr int maxSdfResolution = 4096;
+  // Per emitter, before the quality multiplier.
+  static constexpr int maxEmitterBurst = 100000;
+
+  std::string name = "default";
+  glm::vec2 containerMin = {-0.85f, -0.85f};
+  glm::vec2 containerMax = {0.85f, 0.85f};
+  int sdfResolution = 256; // 16 .. maxSdfResolution
+  std::vector<std::vector<glm::vec2>> polygons;
+  std::vector<ScenePolyline> polylines;
+  std::vector<SceneEmitter> emitters = {SceneEmitter{}};
+  std::vector<SceneSink> sinks;
+
+  int GetSegmentCount() const;
+  // Empty if every field is in range and every coordinate finite, else the
+  // first problem found. Scene files and checkpoints both go through it.
+  std::string Validate() const;
+  static Scene Default();
+};
+
+// Loads a scene from a polyline text file or, for *.svg, from the
+// M/L/H/V/Z path subset plus <polygon>/<polyline> elements. Curves are
+// flattened to their end points. Prints the reason and returns false on
+// failure.
+bool LoadSceneFile(const std::string &path, Scene &out);
+
+// Ear-clipping triangulation of a simple polygon (either winding).
+void TriangulatePolygon(const std::vector<glm::vec2> &poly,
+                        std::vector<glm::vec2> &outTris);
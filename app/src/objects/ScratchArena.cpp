@@ -0,0 +1,77 @@
+#include "ScratchArena.h"
+#include <algorithm>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static size_t RoundUp(size_t v, size_t a) { return (v + a - 1) / a * a; }
+
+ScratchArena::~ScratchArena() {
+  FreeBlock(block_);
+  for (auto &b : overflow_)
+    FreeBlock(b);
+}
+
+ScratchArena::Block ScratchArena::NewBlock(size_t bytes) {
+  Block b;
+  b.align = bytes >= HugePage ? HugePage : 4096;
+  b.size = RoundUp(std::max<size_t>(bytes, 1), b.align);
+  b.data = static_cast<std::byte *>(
+      ::operator new(b.size, std::align_val_t(b.align)));
+#ifdef MADV_HUGEPAGE
+  if (b.align == HugePage)
+    madvise(b.data, b.size, MADV_HUGEPAGE);
+#endif
+  ++blockAllocations_;
+  return b;
+}
+
+void ScratchArena::FreeBlock(Block &b) {
+  if (b.data)
+    ::operator delete(b.data, std::align_val_t(b.align));
+  b = Block{};
+}
+
+void *ScratchArena::AllocBytes(size_t bytes) {
+  bytes = RoundUp(std::max<size_t>(bytes, 1), CacheLine);
+  // used_ only reaches past the block once overflow has started, and from
+  // then on every allocation gets its own overflow block.
+  size_t offset = used_;
+  used_ += bytes;
+  highWater_ = std::max(highWater_, used_);
+  if (used_ <= block_.size)
+    return block_.data + offset;
+  overflow_.push_back(NewBlock(bytes));
+  return overflow_.back().data;
+}
+
+void ScratchArena::Reset() {
+  used_ = 0;
+  if (overflow_.empty())
+    return;
+  for (auto &b : overflow_)
+    FreeBlock(b);
+  overflow_.clear();
+  Reserve(highWater_);
+}
+
+void ScratchArena::Reserve(size_t bytes) {
+  if (bytes <= block_.size)
+    return;
+  FreeBlock(block_);
+  block_ = NewBlock(bytes);
+}
+
+size_t ScratchArena::GetBytes() const {
+  size_t total = block_.size;
+  for (const auto &b : overflow_)
+    total += b.size;
+  return total;
+}
+
+size_t ScratchArena::EstimateBytes(size_t bytes, int allocations) {
+  size_t padded = RoundUp(bytes + (size_t)allocations * CacheLine, CacheLine);
+  return RoundUp(padded, padded >= HugePage ? HugePage : 4096);
+}
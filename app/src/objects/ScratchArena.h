@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for per-step solver temporaries. Every allocation is
+// cache-line aligned and stays valid until the next Reset(). Blocks of 2 MiB
+// or more are huge-page aligned (and advised for transparent huge pages on
+// Linux). A cycle that outgrows the block spills into overflow blocks; the
+// next Reset() replaces them with one block of the high-water size, so a
+// steady state never goes back to the heap.
+class ScratchArena {
+public:
+  static constexpr size_t CacheLine = 64;
+  static constexpr size_t HugePage = size_t(2) << 20;
+
+  ScratchArena() = default;
+  ~ScratchArena();
+  ScratchArena(const ScratchArena &) = delete;
+  ScratchArena &operator=(const ScratchArena &) = delete;
+
+  // `count` default-initialised elements (so scalars are left undefined).
+  template <class T> std::span<T> Alloc(size_t count);
+
+  // Invalidates every allocation.
+  void Reset();
+  // Grows the block to at least `bytes`; only between cycles.
+  void Reserve(size_t bytes);
+
+  size_t GetBytes() const;                       // block plus overflow
+  size_t GetHighWater() const { return highWater_; } // largest cycle so far
+  int GetBlockAllocations() const { return blockAllocations_; }
+
+  // Block size for `bytes` of payload in `allocations` pieces.
+  static size_t EstimateBytes(size_t bytes, int allocations);
+
+private:
+  struct Block {
+    std::byte *data = nullptr;
+    size_t size = 0;
+    size_t align = 0;
+  };
+  Block NewBlock(size_t bytes);
+  static void FreeBlock(Block &b);
+  void *AllocBytes(size_t bytes);
+
+  Block block_;
+  size_t used_ = 0; // bytes of this cycle, overflow included
+  size_t highWater_ = 0;
+  int blockAllocations_ = 0;
+  std::vector<Block> overflow_;
+};
+
+template <class T> std::span<T> ScratchArena::Alloc(size_t count) {
+  static_assert(std::is_trivially_destructible_v<T>,
+                "Reset() runs no destructors");
+  static_assert(alignof(T) <= CacheLine);
+  T *p = static_cast<T *>(AllocBytes(count * sizeof(T)));
+  std::uninitialized_default_construct_n(p, count);
+  return {p, count};
+}
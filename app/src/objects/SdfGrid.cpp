@@ -0,0 +1,105 @@
+#include "SdfGrid.h"
+#include <algorithm>
+#include <cmath>
+
+void SdfGrid::SetDomain(glm::vec2 min, glm::vec2 max, int resolution) {
+  domainMin_ = min;
+  domainMax_ = max;
+  glm::vec2 ext = max - min;
+  cell_ = std::max(ext.x, ext.y) / (float)std::max(resolution, 2);
+  invCell_ = 1.0f / cell_;
+  // Sample() interpolates between two nodes on each axis.
+  nx_ = std::max((int)std::ceil(ext.x * invCell_) + 1, 2);
+  ny_ = std::max((int)std::ceil(ext.y * invCell_) + 1, 2);
+}
+
+void SdfGrid::SetContainer(glm::vec2 min, glm::vec2 max) {
+  boxMin_ = min;
+  boxMax_ = max;
+}
+
+void SdfGrid::AddPolygon(const std::vector<glm::vec2> &pts) {
+  if (pts.size() < 3)
+    return;
+  for (size_t i = 0, j = pts.size() - 1; i < pts.size(); j = i++)
+    pending_.push_back({pts[j], pts[i], 0.0f, true});
+}
+
+void SdfGrid::AddPolyline(const std::vector<glm::vec2> &pts,
+                          float thickness) {
+  for (size_t i = 1; i < pts.size(); ++i)
+    pending_.push_back({pts[i - 1], pts[i], thickness * 0.5f, false});
+}
+
+glm::vec2 SdfGrid::ClosestOnSegment(glm::vec2 p, glm::vec2 a, glm::vec2 b) {
+  glm::vec2 ab = b - a;
+  float len2 = glm::dot(ab, ab);
+  if (len2 <= 0.0f)
+    return a;
+  float t = glm::clamp(glm::dot(p - a, ab) / len2, 0.0f, 1.0f);
+  return a + t * ab;
+}
+
+float SdfGrid::ExactDistance(glm::vec2 p) const {
+  // Container: positive inside the box.
+  glm::vec2 c = (boxMin_ + boxMax_) * 0.5f;
+  glm::vec2 half = (boxMax_ - boxMin_) * 0.5f;
+  glm::vec2 q = glm::abs(p - c) - half;
+  glm::vec2 qo = glm::max(q, glm::vec2(0.0f));
+  float box = glm::length(qo) + std::min(std::max(q.x, q.y), 0.0f);
+  float d = -box;
+
+  SegmentHit hit;
+  if (bvh_.Nearest(p, 1e30f, hit)) {
+    float ds = bvh_.InsideSolid(p) ? -std::abs(hit.dist) : hit.dist;
+    d = std::min(d, ds);
+  }
+  return d;
+}
+
+void SdfGrid::Build() {
+  if (nx_ == 0)
+    SetDomain(domainMin_, domainMax_, 256);
+  bvh_.Build(pending_);
+
+  nodes_.assign((size_t)nx_ * ny_, glm::vec3(0.0f));
+  for (int y = 0; y < ny_; ++y)
+    for (int x = 0; x < nx_; ++x) {
+      glm::vec2 p = domainMin_ + glm::vec2((float)x, (float)y) * cell_;
+      nodes_[(size_t)y * nx_ + x].x = ExactDistance(p);
+    }
+
+  // Central differences inside, one-sided on the border.
+  for (int y = 0; y < ny_; ++y)
+    for (int x = 0; x < nx_; ++x) {
+      int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, nx_ - 1);
+      int y0 = std::max(y - 1, 0), y1 = std::min(y + 1, ny_ - 1);
+      auto at = [&](int i, int j) { return nodes_[(size_t)j * nx_ + i].x; };
+      float dx = at(x1, y) - at(x0, y);
+      float dy = at(x, y1) - at(x, y0);
+      auto &n = nodes_[(size_t)y * nx_ + x];
+      n.y = dx / ((x1 - x0) * cell_);
+      n.z = dy / ((y1 - y0) * cell_);
+    }
+}
+
+SdfSample SdfGrid::Sample(glm::vec2 p) const {
+  float fx = glm::clamp((p.x - domainMin_.x) * invCell_, 0.0f,
+                        (float)(nx_ - 1) - 1e-4f);
+  float fy = glm::clamp((p.y - domainMin_.y) * invCell_, 0.0f,
+                        (float)(ny_ - 1) - 1e-4f);
+  int ix = (int)fx, iy = (int)fy;
+  float tx = fx - ix, ty = fy - iy;
+
+  const glm::vec3 *row0 = &nodes_[(size_t)iy * nx_ + ix];
+  const glm::vec3 *row1 = row0 + nx_;
+  glm::vec3 a = row0[0] + (row0[1] - row0[0]) * tx;
+  glm::vec3 b = row1[0] + (row1[1] - row1[0]) * tx;
+  glm::vec3 s = a + (b - a) * ty;
+
+  // Outside the baked domain the clamped sample underestimates depth; add
+  // the clamp offset so escaped particles are still pushed all the way back.
+  glm::vec2 clamped = domainMin_ + glm::vec2(fx, fy) * cell_;
+  float extra = glm::length(p - clamped);
+  return {s.x - extra, {s.y, s.z}};
+}
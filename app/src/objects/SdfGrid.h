@@ -0,0 +1,47 @@
+#pragma once
+#include "SegmentBvh.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+struct SdfSample {
+  float dist;     // > 0 inside the fluid domain
+  glm::vec2 grad; // points away from the nearest boundary (unnormalized)
+};
+
+// Static boundary geometry baked into a node-centred signed distance grid.
+// The fluid domain is the container box minus every solid polygon and
+// thickened polyline; lookups are a single bilinear fetch of (distance,
+// gradient) regardless of how much geometry went into the bake. The segment
+// BVH used for the bake is kept for exact queries.
+class SdfGrid {
+public:
+  void SetDomain(glm::vec2 min, glm::vec2 max, int resolution);
+  void SetContainer(glm::vec2 min, glm::vec2 max);
+  void AddPolygon(const std::vector<glm::vec2> &pts);
+  void AddPolyline(const std::vector<glm::vec2> &pts, float thickness);
+  void ClearGeometry() { pending_.clear(); }
+  void Build();
+
+  SdfSample Sample(glm::vec2 p) const;
+  float GetCellSize() const { return cell_; }
+  glm::vec2 GetContainerMin() const { return boxMin_; }
+  glm::vec2 GetContainerMax() const { return boxMax_; }
+  const SegmentBvh &GetBvh() const { return bvh_; }
+
+  static glm::vec2 ClosestOnSegment(glm::vec2 p, glm::vec2 a, glm::vec2 b);
+
+private:
+  float ExactDistance(glm::vec2 p) const;
+
+  glm::vec2 domainMin_ = {-1.0f, -1.0f};
+  glm::vec2 domainMax_ = {1.0f, 1.0f};
+  int nx_ = 0, ny_ = 0; // node counts
+  float cell_ = 0.0f, invCell_ = 0.0f;
+
+  glm::vec2 boxMin_ = {-1.0f, -1.0f};
+  glm::vec2 boxMax_ = {1.0f, 1.0f};
+  std::vector<BoundarySegment> pending_;
+  SegmentBvh bvh_;
+
+  std::vector<glm::vec3> nodes_; // distance, d/dx, d/dy
+};
@@ -0,0 +1,151 @@
+#include "SegmentBvh.h"
+#include "SdfGrid.h"
+#include <algorithm>
+#include <cmath>
+
+void SegmentBvh::Clear() {
+  segments_.clear();
+  nodes_.clear();
+}
+
+void SegmentBvh::Build(std::vector<BoundarySegment> segments) {
+  segments_ = std::move(segments);
+  nodes_.clear();
+  if (segments_.empty())
+    return;
+  nodes_.reserve(2 * segments_.size() / leafSize_ + 1);
+  BuildNode(0, (int)segments_.size());
+}
+
+int SegmentBvh::BuildNode(int first, int count) {
+  int index = (int)nodes_.size();
+  nodes_.push_back({});
+
+  glm::vec2 bmin(1e30f), bmax(-1e30f), cmin(1e30f), cmax(-1e30f);
+  for (int i = first; i < first + count; ++i) {
+    const auto &s = segments_[i];
+    glm::vec2 r(s.radius);
+    bmin = glm::min(bmin, glm::min(s.a, s.b) - r);
+    bmax = glm::max(bmax, glm::max(s.a, s.b) + r);
+    glm::vec2 c = (s.a + s.b) * 0.5f;
+    cmin = glm::min(cmin, c);
+    cmax = glm::max(cmax, c);
+  }
+  nodes_[index].min = bmin;
+  nodes_[index].max = bmax;
+
+  if (count <= leafSize_) {
+    nodes_[index].first = first;
+    nodes_[index].count = count;
+    return index;
+  }
+
+  // Median split on the longest centroid axis keeps the tree balanced, so
+  // depth stays ~log2(n / leafSize_) well under maxDepth_.
+  int axis = (cmax.x - cmin.x) >= (cmax.y - cmin.y) ? 0 : 1;
+  int mid = first + count / 2;
+  std::nth_element(segments_.begin() + first, segments_.begin() + mid,
+                   segments_.begin() + first + count,
+                   [axis](const BoundarySegment &l, const BoundarySegment &r) {
+                     return (l.a[axis] + l.b[axis]) < (r.a[axis] + r.b[axis]);
+                   });
+
+  BuildNode(first, mid - first); // left child is always index + 1
+  int right = BuildNode(mid, first + count - mid);
+  nodes_[index].first = right;
+  nodes_[index].count = 0;
+  return index;
+}
+
+float SegmentBvh::BoxDistance2(glm::vec2 p, const Node &n) {
+  glm::vec2 d = glm::max(glm::max(n.min - p, p - n.max), glm::vec2(0.0f));
+  return glm::dot(d, d);
+}
+
+SegmentHit SegmentBvh::HitSegment(glm::vec2 p, const BoundarySegment &s) {
+  SegmentHit h;
+  h.point = SdfGrid::ClosestOnSegment(p, s.a, s.b);
+  glm::vec2 diff = p - h.point;
+  float len = glm::length(diff);
+  if (len > 1e-7f) {
+    h.normal = diff / len;
+  } else {
+    // On the centre line: use the segment's side normal. A zero-length
+    // segment (a repeated polyline point) still has a thickness, so it is
+    // kept and given a fixed normal instead.
+    glm::vec2 t = s.b - s.a;
+    float tl = glm::length(t);
+    h.normal = tl > 1e-7f ? glm::vec2(-t.y, t.x) / tl : glm::vec2(0.0f, 1.0f);
+  }
+  h.dist = len - s.radius;
+  return h;
+}
+
+bool SegmentBvh::Nearest(glm::vec2 p, float maxDist, SegmentHit &out) const {
+  if (nodes_.empty())
+    return false;
+  bool found = false;
+  float best = maxDist;
+  int stack[maxDepth_];
+  int sp = 0;
+  stack[sp++] = 0;
+  while (sp > 0) {
+    int ni = stack[--sp];
+    const Node &n = nodes_[ni];
+    // Boxes include the segment thickness, so outside a box the box distance
+    // bounds the surface distance; inside it the surface may be negative.
+    float bd2 = BoxDistance2(p, n);
+    if (bd2 > 0.0f && std::sqrt(bd2) > best)
+      continue;
+    if (n.count > 0) {
+      for (int i = n.first; i < n.first + n.count; ++i) {
+        SegmentHit h = HitSegment(p, segments_[i]);
+        if (h.dist < best) {
+          best = h.dist;
+          out = h;
+          found = true;
+        }
+      }
+      continue;
+    }
+    if (sp + 2 > maxDepth_)
+      continue;
+    // Visit the nearer child first so `best` shrinks early.
+    int l = ni + 1, r = n.first;
+    if (BoxDistance2(p, nodes_[l]) < BoxDistance2(p, nodes_[r]))
+      std::swap(l, r);
+    stack[sp++] = l;
+    stack[sp++] = r;
+  }
+  return found;
+}
+
+bool SegmentBvh::InsideSolid(glm::vec2 p) const {
+  if (nodes_.empty())
+    return false;
+  bool inside = false;
+  int stack[maxDepth_];
+  int sp = 0;
+  stack[sp++] = 0;
+  while (sp > 0) {
+    int ni = stack[--sp];
+    const Node &n = nodes_[ni];
+    // the +x ray only meets boxes that straddle p.y and reach past p.x
+    if (p.y < n.min.y || p.y > n.max.y || p.x > n.max.x)
+      continue;
+    if (n.count > 0) {
+      for (int i = n.first; i < n.first + n.count; ++i) {
+        const auto &s = segments_[i];
+        if (!s.solid)
+          continue;
+        if ((s.a.y > p.y) != (s.b.y > p.y) &&
+            p.x < s.a.x + (p.y - s.a.y) * (s.b.x - s.a.x) / (s.b.y - s.a.y))
+          inside = !inside;
+      }
+    } else if (sp + 2 <= maxDepth_) {
+      stack[sp++] = n.first;
+      stack[sp++] = ni + 1;
+    }
+  }
+  return inside;
+}
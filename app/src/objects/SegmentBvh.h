@@ -0,0 +1,83 @@
+#pragma once
+#include "CpuFeatures.h"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+struct BoundarySegment {
+  glm::vec2 a, b;
+  float radius = 0.0f; // half thickness; 0 for polygon edges
+  bool solid = false;  // edge of a closed polygon (counts for inside tests)
+};
+
+struct SegmentHit {
+  glm::vec2 point;  // closest point on the segment centre line
+  glm::vec2 normal; // from the surface towards the query point
+  float dist;       // distance to the thickened surface
+};
+
+// Bounding-volume hierarchy over static boundary segments. Built once per
+// scene; nodes are stored depth-first so traversal walks memory forward.
+class SegmentBvh {
+public:
+  void Build(std::vector<BoundarySegment> segments);
+  void Clear();
+
+  bool Empty() const { return segments_.empty(); }
+  int GetSegmentCount() const { return (int)segments_.size(); }
+  int GetNodeCount() const { return (int)nodes_.size(); }
+  const std::vector<BoundarySegment> &GetSegments() const { return segments_; }
+
+  // Nearest thickened segment within maxDist; false if there is none.
+  bool Nearest(glm::vec2 p, float maxDist, SegmentHit &out) const;
+  // Even-odd crossing test against solid (polygon) edges.
+  bool InsideSolid(glm::vec2 p) const;
+
+  // Calls fn(hit) for every segment whose surface is closer than radius.
+  template <typename Fn>
+  void ForEachWithin(glm::vec2 p, float radius, Fn fn) const;
+
+private:
+  struct Node {
+    glm::vec2 min, max;
+    int32_t first; // leaf: first segment, inner: index of right child
+    int32_t count; // leaf: segment count, inner: 0
+  };
+
+  static constexpr int leafSize_ = 4;
+  static constexpr int maxDepth_ = 64;
+
+  int BuildNode(int first, int count);
+  static float BoxDistance2(glm::vec2 p, const Node &n);
+  static SegmentHit HitSegment(glm::vec2 p, const BoundarySegment &s);
+
+  std::vector<BoundarySegment> segments_;
+  std::vector<Node> nodes_;
+};
+
+template <typename Fn>
+FLUID_PASS_INLINE void SegmentBvh::ForEachWithin(glm::vec2 p, float radius,
+                                                 Fn fn) const {
+  if (nodes_.empty())
+    return;
+  int stack[maxDepth_];
+  int sp = 0;
+  stack[sp++] = 0;
+  float r2 = radius * radius;
+  while (sp > 0) {
+    int ni = stack[--sp];
+    const Node &n = nodes_[ni];
+    if (BoxDistance2(p, n) > r2)
+      continue;
+    if (n.count > 0) {
+      for (int i = n.first; i < n.first + n.count; ++i) {
+        SegmentHit h = HitSegment(p, segments_[i]);
+        if (h.dist < radius)
+          fn(h);
+      }
+    } else if (sp + 2 <= maxDepth_) {
+      stack[sp++] = n.first;
+      stack[sp++] = ni + 1;
+    }
+  }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+// SPH smoothing kernels in 2D with support radius h, as solver policies.
+// Coefficients are folded once per pass in the constructor, and the members
+// are branch-free inside the support:
+//   W(r2)           kernel value; zero outside the support
+//   Grad(r_vec, r)  gradient, for 0 < r < h only
+//   ViscLap(r)      viscosity Laplacian weight (>= 0), for 0 < r < h only
+// The caller does the single support test per pair.
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Müller et al. 2003: Poly6 density, Spiky gradient, viscosity Laplacian.
+struct MullerKernels {
+  explicit MullerKernels(float h)
+      : h_(h), h2_(h * h),
+        poly6_(4.0f / ((float)M_PI * std::pow(h, 8.0f))),
+        spiky_(-(30.0f / ((float)M_PI * std::pow(h, 5.0f)))),
+        visc_(40.0f / ((float)M_PI * std::pow(h, 5.0f))) {}
+
+  float W(float r2) const {
+    float f = std::max(h2_ - r2, 0.0f);
+    return poly6_ * f * f * f;
+  }
+  glm::vec2 Grad(glm::vec2 r_vec, float r_len) const {
+    float f = h_ - r_len;
+    float coeff = spiky_ * f * f;
+    return coeff * (r_vec / r_len);
+  }
+  float ViscLap(float r_len) const { return visc_ * (h_ - r_len); }
+
+private:
+  float h_, h2_, poly6_, spiky_, visc_;
+};
+
+// Wendland C2, sigma = 7 / (pi h^2). Smoother than Poly6 and free of the
+// pairing instability. The Laplacian is Brookshaw's -2 W'(r) / r.
+struct WendlandKernels {
+  explicit WendlandKernels(float h)
+      : invH_(1.0f / h), sigma_(7.0f / ((float)M_PI * h * h)),
+        grad_(-20.0f * sigma_ / (h * h)), visc_(40.0f * sigma_ / (h * h)) {}
+
+  float W(float r2) const {
+    float q = std::sqrt(r2) * invH_;
+    float f = std::max(1.0f - q, 0.0f);
+    float f2 = f * f;
+    return sigma_ * f2 * f2 * (1.0f + 4.0f * q);
+  }
+  glm::vec2 Grad(glm::vec2 r_vec, float r_len) const {
+    float f = 1.0f - r_len * invH_;
+    return grad_ * f * f * f * r_vec;
+  }
+  float ViscLap(float r_len) const {
+    float f = 1.0f - r_len * invH_;
+    return visc_ * f * f * f;
+  }
+
+private:
+  float invH_, sigma_, grad_, visc_;
+};
+
+// Monaghan's cubic B-spline, sigma = 40 / (7 pi h^2). The two pieces are
+// written as 2 (1-q)^3 - 8 (1/2-q)^3 with both terms clamped at zero.
+struct CubicSplineKernels {
+  explicit CubicSplineKernels(float h)
+      : invH_(1.0f / h), sigma_(40.0f / (7.0f * (float)M_PI * h * h)),
+        dq_(sigma_ / h) {}
+
+  float W(float r2) const {
+    float q = std::sqrt(r2) * invH_;
+    float a = std::max(1.0f - q, 0.0f);
+    float b = std::max(0.5f - q, 0.0f);
+    return sigma_ * (2.0f * a * a * a - 8.0f * b * b * b);
+  }
+  glm::vec2 Grad(glm::vec2 r_vec, float r_len) const {
+    return DwDr(r_len) * (r_vec / r_len);
+  }
+  float ViscLap(float r_len) const { return -2.0f * DwDr(r_len) / r_len; }
+
+private:
+  float DwDr(float r_len) const {
+    float q = r_len * invH_;
+    float a = 1.0f - q;
+    float b = std::max(0.5f - q, 0.0f);
+    return dq_ * (24.0f * b * b - 6.0f * a * a);
+  }
+
+  float invH_, sigma_, dq_;
+};
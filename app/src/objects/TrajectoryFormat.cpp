@@ -0,0 +1,108 @@
+#include "TrajectoryFormat.h"
+#include <algorithm>
+#include <cmath>
+
+TrajectoryQuantizer TrajectoryQuantizer::ForBounds(glm::vec2 min,
+                                                   glm::vec2 max) {
+  TrajectoryQuantizer q;
+  q.origin = min;
+  q.step = glm::max(max - min, glm::vec2(1e-6f)) / 65535.0f;
+  return q;
+}
+
+void TrajectoryQuantizer::Quantize(std::span<const glm::vec3> in,
+                                   QuantizedFrame &out) const {
+  int n = (int)in.size();
+  out.Resize(n);
+  for (int i = 0; i < n; ++i) {
+    float qx = std::round((in[i].x - origin.x) / step.x);
+    float qy = std::round((in[i].y - origin.y) / step.y);
+    out.x[i] = (int32_t)std::clamp(qx, 0.0f, 65535.0f);
+    out.y[i] = (int32_t)std::clamp(qy, 0.0f, 65535.0f);
+    out.speed[i] = (int32_t)std::min(std::round(in[i].z / speedStep), 1e9f);
+  }
+}
+
+void TrajectoryQuantizer::Dequantize(const QuantizedFrame &in,
+                                     std::vector<glm::vec3> &out) const {
+  int n = in.GetCount();
+  out.resize(n);
+  for (int i = 0; i < n; ++i)
+    out[i] = {origin.x + in.x[i] * step.x, origin.y + in.y[i] * step.y,
+              in.speed[i] * speedStep};
+}
+
+static void PutVarint(std::vector<uint8_t> &out, int32_t v) {
+  uint32_t z = ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); // zigzag
+  while (z >= 0x80) {
+    out.push_back((uint8_t)(z | 0x80));
+    z >>= 7;
+  }
+  out.push_back((uint8_t)z);
+}
+
+static bool GetVarint(const uint8_t *&p, const uint8_t *end, int32_t &v) {
+  uint32_t z = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (p == end)
+      return false;
+    uint8_t b = *p++;
+    z |= (uint32_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      v = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Prediction for slot i of a plane: linear extrapolation from the same slot
+// in the two earlier frames, the slot one frame earlier, or the previous
+// slot of this frame.
+static int32_t Predict(const std::vector<int32_t> &cur,
+                       const std::vector<int32_t> *prev,
+                       const std::vector<int32_t> *prev2, int i) {
+  if (prev && i < (int)prev->size()) {
+    if (prev2 && i < (int)prev2->size())
+      return 2 * (*prev)[i] - (*prev2)[i];
+    return (*prev)[i];
+  }
+  return i > 0 ? cur[i - 1] : 0;
+}
+
+void EncodeTrajectoryFrame(const QuantizedFrame &cur,
+                           const QuantizedFrame *prev,
+                           const QuantizedFrame *prev2,
+                           std::vector<uint8_t> &out) {
+  for (int c = 0; c < 3; ++c) {
+    const std::vector<int32_t> &plane = cur.Plane(c);
+    const std::vector<int32_t> *p1 = prev ? &prev->Plane(c) : nullptr;
+    // Speed is too noisy from frame to frame to extrapolate.
+    const std::vector<int32_t> *p2 =
+        prev2 && c < 2 ? &prev2->Plane(c) : nullptr;
+    for (int i = 0; i < (int)plane.size(); ++i)
+      PutVarint(out, plane[i] - Predict(plane, p1, p2, i));
+  }
+}
+
+bool DecodeTrajectoryFrame(std::span<const uint8_t> in, int particles,
+                           const QuantizedFrame *prev,
+                           const QuantizedFrame *prev2,
+                           QuantizedFrame &out) {
+  out.Resize(particles);
+  const uint8_t *p = in.data(), *end = p + in.size();
+  for (int c = 0; c < 3; ++c) {
+    std::vector<int32_t> &plane = out.Plane(c);
+    const std::vector<int32_t> *p1 = prev ? &prev->Plane(c) : nullptr;
+    // Speed is too noisy from frame to frame to extrapolate.
+    const std::vector<int32_t> *p2 =
+        prev2 && c < 2 ? &prev2->Plane(c) : nullptr;
+    for (int i = 0; i < particles; ++i) {
+      int32_t d;
+      if (!GetVarint(p, end, d))
+        return false;
+      plane[i] = d + Predict(plane, p1, p2, i);
+    }
+  }
+  return p == end;
+}
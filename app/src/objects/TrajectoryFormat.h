@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+// Trajectory file layout, written by TrajectoryRecorder:
+//   TrajectoryFileHeader
+//   per frame: TrajectoryFrameHeader, then the LZ-packed payload
+//   per frame: TrajectoryIndexEntry, then TrajectoryFooter
+// Every value is in native byte order. The payload is three planes (x, y,
+// speed) of zigzag LEB128 varints, one value per particle in slot order.
+// Key frames predict each value from the previous particle in the plane.
+// The other frames predict from the same slot one frame earlier; positions
+// extrapolate linearly from the two earlier frames once there are two since
+// the key frame. Slots the earlier frames lack fall back to the shorter
+// rules. A reader can start at any key frame; a file without a footer can
+// still be scanned frame by frame.
+
+inline constexpr char trajectoryMagic[8] = {'F', 'L', 'U', 'I', 'D',
+                                            'T', 'R', 0};
+inline constexpr uint32_t trajectoryVersion = 1;
+inline constexpr uint32_t trajectoryFrameMagic = 0x454d5246;  // "FRME"
+inline constexpr uint32_t trajectoryFooterMagic = 0x58444954; // "TIDX"
+inline constexpr uint32_t trajectoryKeyFrame = 1;              // frame flag
+
+struct TrajectoryFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t keyInterval; // frames between key frames
+  float origin[2];      // quantisation grid for positions
+  float step[2];
+  float speedStep;
+  uint32_t reserved;
+};
+
+struct TrajectoryFrameHeader {
+  uint32_t magic;
+  uint32_t flags;
+  uint32_t index;
+  uint32_t particles;
+  uint32_t rawBytes; // payload before LZ
+  uint32_t packedBytes;
+  double time; // simulated seconds at the end of the frame
+};
+
+struct TrajectoryIndexEntry {
+  uint64_t offset; // of the frame header
+  uint32_t particles;
+  uint32_t flags;
+  double time;
+};
+
+struct TrajectoryFooter {
+  uint64_t indexOffset;
+  uint32_t frameCount;
+  uint32_t magic;
+};
+
+// One frame on the quantisation grid, as planes.
+struct QuantizedFrame {
+  std::vector<int32_t> x, y, speed;
+
+  int GetCount() const { return (int)x.size(); }
+  std::vector<int32_t> &Plane(int c) {
+    return c == 0 ? x : c == 1 ? y : speed;
+  }
+  const std::vector<int32_t> &Plane(int c) const {
+    return c == 0 ? x : c == 1 ? y : speed;
+  }
+  void Resize(int n) {
+    x.resize(n);
+    y.resize(n);
+    speed.resize(n);
+  }
+};
+
+// Maps instance data (x, y, speed) to and from the grid. Positions are
+// clamped to 16 bits per axis over [min, max].
+struct TrajectoryQuantizer {
+  glm::vec2 origin = {0.0f, 0.0f};
+  glm::vec2 step = {1.0f, 1.0f};
+  float speedStep = 1.0f / 256.0f; // only drives the colour ramp
+
+  static TrajectoryQuantizer ForBounds(glm::vec2 min, glm::vec2 max);
+  void Quantize(std::span<const glm::vec3> in, QuantizedFrame &out) const;
+  void Dequantize(const QuantizedFrame &in, std::vector<glm::vec3> &out) const;
+};
+
+// Appends the varint planes of `cur`. prev and prev2 are the one and two
+// frames before it since the last key frame, or null; no prev makes a key
+// frame.
+void EncodeTrajectoryFrame(const QuantizedFrame &cur,
+                           const QuantizedFrame *prev,
+                           const QuantizedFrame *prev2,
+                           std::vector<uint8_t> &out);
+// Inverse of EncodeTrajectoryFrame for `particles` values per plane.
+bool DecodeTrajectoryFrame(std::span<const uint8_t> in, int particles,
+                           const QuantizedFrame *prev,
+                           const QuantizedFrame *prev2, QuantizedFrame &out);
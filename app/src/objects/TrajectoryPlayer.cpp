@@ -0,0 +1,220 @@
+#include "TrajectoryPlayer.h"
+#include "LzCodec.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Frames whose pages are prefetched past the current one while playing.
+static constexpr int readAheadFrames = 30;
+
+bool TrajectoryPlayer::Open(const std::string &path) {
+  Close();
+  if (!file_.Open(path))
+    return false;
+  TrajectoryFileHeader h;
+  if (file_.GetSize() < sizeof(h)) {
+    std::cerr << "Trajectory " << path << ": file too short\n";
+    Close();
+    return false;
+  }
+  std::memcpy(&h, file_.GetData(), sizeof(h));
+  if (std::memcmp(h.magic, trajectoryMagic, sizeof(h.magic)) != 0 ||
+      h.version != trajectoryVersion) {
+    std::cerr << "Trajectory " << path
+              << ": not a trajectory file of version " << trajectoryVersion
+              << "\n";
+    Close();
+    return false;
+  }
+  quantizer_.origin = {h.origin[0], h.origin[1]};
+  quantizer_.step = {h.step[0], h.step[1]};
+  quantizer_.speedStep = h.speedStep;
+  if (!ReadIndex()) {
+    ScanFrames();
+    std::cerr << "Trajectory " << path << ": no index, recovered "
+              << index_.size() << " frames\n";
+  }
+  if (index_.empty() || !(index_[0].flags & trajectoryKeyFrame)) {
+    std::cerr << "Trajectory " << path << ": no frames\n";
+    Close();
+    return false;
+  }
+  path_ = path;
+  maxParticles_ = 0;
+  for (const TrajectoryIndexEntry &e : index_)
+    maxParticles_ = std::max(maxParticles_, (int)e.particles);
+  if (!SeekFrame(0)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void TrajectoryPlayer::Close() {
+  file_.Close();
+  index_.clear();
+  path_.clear();
+  instances_.clear();
+  frame_ = keyFrame_ = -1;
+  time_ = 0.0;
+  playing_ = false;
+}
+
+double TrajectoryPlayer::GetStartTime() const {
+  return index_.empty() ? 0.0 : index_.front().time;
+}
+
+double TrajectoryPlayer::GetEndTime() const {
+  return index_.empty() ? 0.0 : index_.back().time;
+}
+
+// The footer is only there when the recorder closed the file; the index
+// must then fill the space between the last frame and the footer exactly.
+bool TrajectoryPlayer::ReadIndex() {
+  const uint8_t *data = file_.GetData();
+  size_t size = file_.GetSize();
+  TrajectoryFooter f;
+  if (size < sizeof(TrajectoryFileHeader) + sizeof(f))
+    return false;
+  std::memcpy(&f, data + size - sizeof(f), sizeof(f));
+  // Offsets come from the file, so compare against what is left rather
+  // than adding to them.
+  size_t indexBytes = (size_t)f.frameCount * sizeof(TrajectoryIndexEntry);
+  if (f.magic != trajectoryFooterMagic ||
+      f.indexOffset < sizeof(TrajectoryFileHeader) ||
+      f.indexOffset > size - sizeof(f) ||
+      indexBytes != size - sizeof(f) - f.indexOffset)
+    return false;
+  index_.resize(f.frameCount);
+  std::memcpy(index_.data(), data + f.indexOffset, indexBytes);
+  // Frames are written in order, each before the index.
+  uint64_t next = sizeof(TrajectoryFileHeader);
+  for (const TrajectoryIndexEntry &e : index_) {
+    if (e.offset < next || e.offset > f.indexOffset ||
+        sizeof(TrajectoryFrameHeader) > f.indexOffset - e.offset) {
+      index_.clear();
+      return false;
+    }
+    next = e.offset + sizeof(TrajectoryFrameHeader);
+  }
+  return true;
+}
+
+void TrajectoryPlayer::ScanFrames() {
+  const uint8_t *data = file_.GetData();
+  size_t size = file_.GetSize();
+  size_t at = sizeof(TrajectoryFileHeader);
+  index_.clear();
+  TrajectoryFrameHeader h;
+  while (at + sizeof(h) <= size) {
+    std::memcpy(&h, data + at, sizeof(h));
+    if (h.magic != trajectoryFrameMagic || h.index != index_.size() ||
+        h.packedBytes > size - at - sizeof(h))
+      break;
+    index_.push_back({at, h.particles, h.flags, h.time});
+    at += sizeof(h) + h.packedBytes;
+  }
+}
+
+int TrajectoryPlayer::FrameAt(double t) const {
+  auto it = std::upper_bound(
+      index_.begin(), index_.end(), t,
+      [](double t, const TrajectoryIndexEntry &e) { return t < e.time; });
+  return std::max(0, (int)(it - index_.begin()) - 1);
+}
+
+bool TrajectoryPlayer::Advance(float dt) {
+  if (!playing_ || index_.empty())
+    return false;
+  double t = time_ + (double)dt * speed_;
+  if (t > GetEndTime()) {
+    if (loop_) {
+      t = GetStartTime();
+    } else {
+      t = GetEndTime();
+      playing_ = false;
+    }
+  }
+  return SeekTime(t);
+}
+
+bool TrajectoryPlayer::SeekTime(double t) {
+  if (index_.empty())
+    return false;
+  time_ = std::clamp(t, GetStartTime(), GetEndTime());
+  int frame = FrameAt(time_);
+  if (frame == frame_)
+    return false;
+  double keep = time_;
+  bool decoded = SeekFrame(frame);
+  time_ = keep;
+  return decoded;
+}
+
+bool TrajectoryPlayer::SeekFrame(int frame) {
+  if (index_.empty())
+    return false;
+  frame = std::clamp(frame, 0, (int)index_.size() - 1);
+  time_ = index_[frame].time;
+  if (frame == frame_)
+    return false;
+  int key = frame;
+  while (key > 0 && !(index_[key].flags & trajectoryKeyFrame))
+    --key;
+  int from = frame_ >= key && frame_ < frame ? frame_ + 1 : key;
+  for (int f = from; f <= frame; ++f)
+    if (!DecodeNext(f)) {
+      std::cerr << "Trajectory " << path_ << ": frame " << f
+                << " is corrupt\n";
+      frame_ = keyFrame_ = -1;
+      return false;
+    }
+
+  quantizer_.Dequantize(previous_, instances_);
+  maxSpeed_ = 0.1f;
+  for (const glm::vec3 &v : instances_)
+    maxSpeed_ = std::max(maxSpeed_, v.z);
+  int ahead = std::min(frame + readAheadFrames, (int)index_.size() - 1);
+  if (ahead > frame)
+    file_.WillNeed(index_[frame + 1].offset,
+                   index_[ahead].offset - index_[frame + 1].offset);
+  return true;
+}
+
+bool TrajectoryPlayer::DecodeNext(int frame) {
+  const TrajectoryIndexEntry &e = index_[frame];
+  const uint8_t *data = file_.GetData();
+  TrajectoryFrameHeader h;
+  if (e.offset > file_.GetSize() || sizeof(h) > file_.GetSize() - e.offset)
+    return false;
+  std::memcpy(&h, data + e.offset, sizeof(h));
+  size_t payload = e.offset + sizeof(h);
+  // Each value takes one to five varint bytes, and an LZ sequence can
+  // expand at most ~255x, so these bound the buffers a bad header can ask
+  // for.
+  if (h.magic != trajectoryFrameMagic || h.index != (uint32_t)frame ||
+      h.packedBytes > file_.GetSize() - payload ||
+      h.rawBytes < (uint64_t)h.particles * 3 ||
+      h.rawBytes > (uint64_t)h.particles * 15 ||
+      h.rawBytes > (uint64_t)h.packedBytes * 255)
+    return false;
+  bool key = h.flags & trajectoryKeyFrame;
+  if (key)
+    keyFrame_ = frame;
+  else if (keyFrame_ < 0 || frame_ != frame - 1)
+    return false;
+  raw_.resize(h.rawBytes);
+  if (!LzDecompress({data + payload, h.packedBytes}, raw_))
+    return false;
+  // Mirrors TrajectoryRecorder::WriteFrame.
+  int sinceKey = frame - keyFrame_;
+  if (!DecodeTrajectoryFrame(raw_, (int)h.particles,
+                             sinceKey >= 1 ? &previous_ : nullptr,
+                             sinceKey >= 2 ? &previous2_ : nullptr,
+                             current_))
+    return false;
+  std::swap(previous2_, previous_);
+  std::swap(previous_, current_);
+  frame_ = frame;
+  return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "MappedFile.h"
+#include "TrajectoryFormat.h"
+#include <glm/glm.hpp>
+#include <span>
+#include <string>
+#include <vector>
+
+// Plays back a file written by TrajectoryRecorder straight from a memory
+// mapping; the only per-frame work is LZ and delta decoding. A frame depends
+// on the frames back to its key frame, so a seek decodes forward from the
+// current frame when that is on the way, otherwise from the nearest key
+// frame at or before the target.
+class TrajectoryPlayer {
+public:
+  // Reads the index from the footer, or scans the frames of a file whose
+  // recording was cut short. Prints the reason and returns false on failure.
+  bool Open(const std::string &path);
+  void Close();
+  bool IsOpen() const { return !index_.empty(); }
+  const std::string &GetPath() const { return path_; }
+
+  int GetFrameCount() const { return (int)index_.size(); }
+  // Most particles in any frame.
+  int GetMaxParticles() const { return maxParticles_; }
+  // Index of the decoded frame, -1 before the first.
+  int GetFrame() const { return frame_; }
+  double GetStartTime() const;
+  double GetEndTime() const;
+  // Playback clock in recorded simulation seconds.
+  double GetTime() const { return time_; }
+
+  void SetPlaying(bool on) { playing_ = on; }
+  bool GetPlaying() const { return playing_; }
+  // Recorded seconds per real second.
+  void SetSpeed(float s) { speed_ = glm::clamp(s, 0.05f, 16.0f); }
+  float GetSpeed() const { return speed_; }
+  void SetLoop(bool on) { loop_ = on; }
+  bool GetLoop() const { return loop_; }
+
+  // Moves the clock by dt * speed while playing, wrapping or stopping at
+  // the end, and decodes the frame due. True if a new frame was decoded.
+  bool Advance(float dt);
+  // Sets the clock and decodes the frame due then (the last one recorded
+  // at or before t). True if a new frame was decoded.
+  bool SeekTime(double t);
+  bool SeekFrame(int frame);
+
+  // Decoded instances (x, y, speed) of the current frame.
+  std::span<const glm::vec3> GetInstances() const { return instances_; }
+  float GetMaxSpeed() const { return maxSpeed_; }
+
+private:
+  bool ReadIndex();
+  void ScanFrames();
+  int FrameAt(double t) const;
+  bool DecodeNext(int frame);
+
+  std::string path_;
+  MappedFile file_;
+  TrajectoryQuantizer quantizer_;
+  std::vector<TrajectoryIndexEntry> index_;
+  int maxParticles_ = 0;
+
+  // Decoder state: previous_ holds frame_, previous2_ the frame before it.
+  QuantizedFrame current_, previous_, previous2_;
+  std::vector<uint8_t> raw_;
+  int frame_ = -1;
+  int keyFrame_ = -1; // last key frame decoded
+
+  std::vector<glm::vec3> instances_;
+  float maxSpeed_ = 0.1f;
+  double time_ = 0.0;
+  float speed_ = 1.0f;
+  bool playing_ = false;
+  bool loop_ = true;
+};
@@ -0,0 +1,152 @@
+#include "TrajectoryRecorder.h"
+#include <cstring>
+#include <iostream>
+
+bool TrajectoryRecorder::Open(const std::string &path, glm::vec2 min,
+                              glm::vec2 max, int keyInterval) {
+  Close();
+  file_.open(path, std::ios::binary | std::ios::trunc);
+  if (!file_) {
+    std::cerr << "Cannot write trajectory " << path << "\n";
+    return false;
+  }
+  path_ = path;
+  quantizer_ = TrajectoryQuantizer::ForBounds(min, max);
+  keyInterval_ = keyInterval < 1 ? 1 : keyInterval;
+  index_.clear();
+  offset_ = 0;
+  failed_ = false;
+  head_ = queued_ = 0;
+  quit_ = false;
+  stats_ = {};
+  time_ = 0.0;
+
+  TrajectoryFileHeader h = {};
+  std::memcpy(h.magic, trajectoryMagic, sizeof(h.magic));
+  h.version = trajectoryVersion;
+  h.keyInterval = (uint32_t)keyInterval_;
+  h.origin[0] = quantizer_.origin.x;
+  h.origin[1] = quantizer_.origin.y;
+  h.step[0] = quantizer_.step.x;
+  h.step[1] = quantizer_.step.y;
+  h.speedStep = quantizer_.speedStep;
+  Write(&h, sizeof(h));
+  stats_.fileBytes = offset_;
+  writer_ = std::thread([this] { WriterLoop(); });
+  return true;
+}
+
+void TrajectoryRecorder::Capture(std::span<const glm::vec3> instances,
+                                 float dt) {
+  if (!IsOpen())
+    return;
+  time_ += dt;
+  int slot;
+  {
+    std::unique_lock lock(mutex_);
+    if (queued_ == poolSize_) {
+      ++stats_.stalls;
+      free_.wait(lock, [this] { return queued_ < poolSize_; });
+    }
+    slot = (head_ + queued_) % poolSize_;
+  }
+  // The slot is outside the queue, so the writer does not touch it.
+  Frame &f = frames_[slot];
+  f.instances.assign(instances.begin(), instances.end());
+  f.time = time_;
+  {
+    std::lock_guard lock(mutex_);
+    ++queued_;
+    stats_.rawBytes += instances.size_bytes();
+  }
+  ready_.notify_one();
+}
+
+bool TrajectoryRecorder::Close() {
+  if (!IsOpen())
+    return true;
+  {
+    std::lock_guard lock(mutex_);
+    quit_ = true;
+  }
+  ready_.notify_one();
+  writer_.join();
+  file_.close();
+  if (failed_ || file_.fail()) {
+    std::cerr << "Writing trajectory " << path_ << " failed\n";
+    return false;
+  }
+  return true;
+}
+
+TrajectoryStats TrajectoryRecorder::GetStats() {
+  std::lock_guard lock(mutex_);
+  return stats_;
+}
+
+void TrajectoryRecorder::WriterLoop() {
+  for (;;) {
+    int slot;
+    {
+      std::unique_lock lock(mutex_);
+      ready_.wait(lock, [this] { return queued_ > 0 || quit_; });
+      if (queued_ == 0)
+        break;
+      slot = head_;
+    }
+    WriteFrame(frames_[slot]);
+    {
+      std::lock_guard lock(mutex_);
+      head_ = (head_ + 1) % poolSize_;
+      --queued_;
+      ++stats_.frames;
+      stats_.fileBytes = offset_;
+    }
+    free_.notify_one();
+  }
+
+  TrajectoryFooter footer = {};
+  footer.indexOffset = offset_;
+  footer.frameCount = (uint32_t)index_.size();
+  footer.magic = trajectoryFooterMagic;
+  Write(index_.data(), index_.size() * sizeof(TrajectoryIndexEntry));
+  Write(&footer, sizeof(footer));
+  std::lock_guard lock(mutex_);
+  stats_.fileBytes = offset_;
+}
+
+void TrajectoryRecorder::WriteFrame(const Frame &frame) {
+  uint32_t number = (uint32_t)index_.size();
+  // Key frames stand alone so a reader can seek to them.
+  uint32_t sinceKey = number % (uint32_t)keyInterval_;
+  bool key = sinceKey == 0;
+  quantizer_.Quantize(frame.instances, current_);
+  raw_.clear();
+  EncodeTrajectoryFrame(current_, sinceKey >= 1 ? &previous_ : nullptr,
+                        sinceKey >= 2 ? &previous2_ : nullptr, raw_);
+  packed_.clear();
+  packed_.reserve(LzEncoder::Bound(raw_.size()));
+  lz_.Compress(raw_, packed_);
+
+  TrajectoryFrameHeader h = {};
+  h.magic = trajectoryFrameMagic;
+  h.flags = key ? trajectoryKeyFrame : 0;
+  h.index = number;
+  h.particles = (uint32_t)current_.GetCount();
+  h.rawBytes = (uint32_t)raw_.size();
+  h.packedBytes = (uint32_t)packed_.size();
+  h.time = frame.time;
+  index_.push_back({offset_, h.particles, h.flags, h.time});
+  Write(&h, sizeof(h));
+  Write(packed_.data(), packed_.size());
+  std::swap(previous2_, previous_);
+  std::swap(previous_, current_);
+}
+
+void TrajectoryRecorder::Write(const void *data, size_t bytes) {
+  if (failed_ || bytes == 0)
+    return;
+  file_.write((const char *)data, (std::streamsize)bytes);
+  failed_ = !file_;
+  offset_ += bytes;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "LzCodec.h"
+#include "TrajectoryFormat.h"
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct TrajectoryStats {
+  uint64_t frames = 0;
+  uint64_t rawBytes = 0;  // instance data handed to Capture()
+  uint64_t fileBytes = 0; // written so far
+  uint64_t stalls = 0;    // Capture() calls that waited for the writer
+
+  double Ratio() const {
+    return fileBytes ? (double)rawBytes / (double)fileBytes : 0.0;
+  }
+};
+
+// Streams the per-frame instance data (x, y, speed; see FluidSim::
+// GetInstances) to a trajectory file (TrajectoryFormat.h). Capture() only
+// copies the frame into one of a few pooled buffers; quantising, delta
+// coding, LZ packing and the file writes happen on a writer thread. When
+// every buffer is still queued, Capture() waits and counts a stall rather
+// than dropping the frame.
+class TrajectoryRecorder {
+public:
+  TrajectoryRecorder() = default;
+  ~TrajectoryRecorder() { Close(); }
+  TrajectoryRecorder(const TrajectoryRecorder &) = delete;
+  TrajectoryRecorder &operator=(const TrajectoryRecorder &) = delete;
+
+  // Positions are quantised to 16 bits over [min, max]. Prints the reason
+  // and returns false if the file cannot be created.
+  bool Open(const std::string &path, glm::vec2 min, glm::vec2 max,
+            int keyInterval = 60);
+  // One frame that advanced the simulation by dt seconds.
+  void Capture(std::span<const glm::vec3> instances, float dt);
+  // Drains the queue and writes the index. False if any write failed.
+  bool Close();
+  bool IsOpen() const { return writer_.joinable(); }
+  const std::string &GetPath() const { return path_; }
+  TrajectoryStats GetStats();
+
+private:
+  static constexpr int poolSize_ = 4;
+
+  struct Frame {
+    std::vector<glm::vec3> instances;
+    double time = 0.0;
+  };
+
+  void WriterLoop();
+  void WriteFrame(const Frame &frame);
+  void Write(const void *data, size_t bytes);
+
+  std::string path_;
+  std::ofstream file_;
+  std::thread writer_;
+
+  // Ring of pooled frames: [head_, head_ + queued_) wait for the writer,
+  // the rest belong to Capture(). Guarded by mutex_.
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::condition_variable free_;
+  Frame frames_[poolSize_];
+  int head_ = 0, queued_ = 0;
+  bool quit_ = false;
+  TrajectoryStats stats_;
+  double time_ = 0.0; // Capture() side
+
+  // Writer thread only.
+  TrajectoryQuantizer quantizer_;
+  int keyInterval_ = 60;
+  QuantizedFrame current_, previous_, previous2_;
+  std::vector<uint8_t> raw_, packed_;
+  LzEncoder lz_;
+  std::vector<TrajectoryIndexEntry> index_;
+  uint64_t offset_ = 0;
+  bool failed_ = false;
+};
@@ -0,0 +1,82 @@
+#include "Y4mWriter.h"
+#include "ImageCodec.h"
+#include <algorithm>
+#include <iostream>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+bool Y4mWriter::Open(const std::string &path, int width, int height, int fps,
+                     int threads) {
+  Close();
+  if (path == "-") {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    file_ = stdout;
+    ownsFile_ = false;
+  } else {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+      std::cerr << "Cannot open " << path << " for writing\n";
+      return false;
+    }
+    ownsFile_ = true;
+  }
+  // C420jpeg: chroma sited between the four luma samples it covers, which
+  // is how RgbaToI420 averages them. XCOLORRANGE is read by FFmpeg.
+  if (std::fprintf(file_,
+                   "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg "
+                   "XCOLORRANGE=LIMITED\n",
+                   width, height, fps) < 0) {
+    std::cerr << "Cannot write to " << path << "\n";
+    if (ownsFile_)
+      std::fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+  width_ = width;
+  height_ = height;
+  pool_.Open(
+      (size_t)width * height * 4, threads, true,
+      [this](const uint8_t *rgba, int, std::vector<uint8_t> &yuv) {
+        Convert(rgba, yuv);
+      },
+      [this](int frame, const std::vector<uint8_t> &yuv) {
+        return WriteFrame(frame, yuv);
+      });
+  return true;
+}
+
+bool Y4mWriter::Close() {
+  if (!IsOpen())
+    return true;
+  bool ok = pool_.Close();
+  ok = std::fflush(file_) == 0 && ok;
+  if (ownsFile_)
+    ok = std::fclose(file_) == 0 && ok;
+  file_ = nullptr;
+  return ok;
+}
+
+void Y4mWriter::Convert(const uint8_t *rgba,
+                        std::vector<uint8_t> &yuv) const {
+  static const char frameTag[] = "FRAME\n";
+  const size_t tagBytes = sizeof(frameTag) - 1;
+  const size_t lumaBytes = (size_t)width_ * height_;
+  const size_t chromaBytes = (size_t)((width_ + 1) / 2) * ((height_ + 1) / 2);
+  yuv.resize(tagBytes + lumaBytes + 2 * chromaBytes);
+  std::copy(frameTag, frameTag + tagBytes, yuv.begin());
+  uint8_t *y = yuv.data() + tagBytes;
+  RgbaToI420(rgba, width_, height_, true, y, y + lumaBytes,
+             y + lumaBytes + chromaBytes);
+}
+
+bool Y4mWriter::WriteFrame(int frame, const std::vector<uint8_t> &yuv) {
+  if (std::fwrite(yuv.data(), 1, yuv.size(), file_) != yuv.size()) {
+    std::cerr << "Cannot write Y4M frame " << frame << "\n";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "FramePool.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Writes frames as one YUV4MPEG2 stream (4:2:0, progressive) to a file or
+// to stdout, for piping into a video encoder. Takes the same RGBA8
+// bottom-up frames as ImageSequenceWriter, through the same BeginFrame() /
+// SubmitFrame() pair. The worker threads of a FramePool convert frames to
+// YUV in parallel; each frame's input buffer is released as soon as it is
+// converted, and the converted frames are written strictly in order.
+class Y4mWriter {
+public:
+  Y4mWriter() = default;
+  ~Y4mWriter() { Close(); }
+  Y4mWriter(const Y4mWriter &) = delete;
+  Y4mWriter &operator=(const Y4mWriter &) = delete;
+
+  // path "-" is stdout. threads <= 0 uses all cores but one. Prints the
+  // reason and returns false on failure.
+  bool Open(const std::string &path, int width, int height, int fps,
+            int threads = 0);
+  // width * height * 4 bytes for the next frame.
+  uint8_t *BeginFrame() { return pool_.BeginFrame(); }
+  void SubmitFrame() { pool_.SubmitFrame(); }
+  // Waits for every queued frame and closes the file. False if any write
+  // failed.
+  bool Close();
+  bool IsOpen() const { return pool_.IsOpen(); }
+  // frames and bytes written; stalls are BeginFrame() calls that waited.
+  FramePoolStats GetStats() { return pool_.GetStats(); }
+
+private:
+  void Convert(const uint8_t *rgba, std::vector<uint8_t> &yuv) const;
+  bool WriteFrame(int frame, const std::vector<uint8_t> &yuv);
+
+  std::FILE *file_ = nullptr;
+  bool ownsFile_ = false;
+  int width_ = 0, height_ = 0;
+  FramePool pool_;
+};